@@ -3,64 +3,309 @@
 
 #include "ie_backend.hpp"
 
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+static evPrecision toPrecision(InferenceEngine::Precision precision) {
+    switch (precision) {
+    case InferenceEngine::Precision::FP32:
+        return FP32;
+    case InferenceEngine::Precision::FP16:
+        return FP16;
+    case InferenceEngine::Precision::BF16:
+        return BF16;
+    case InferenceEngine::Precision::I16:
+        return I16;
+    case InferenceEngine::Precision::U16:
+        return U16;
+    case InferenceEngine::Precision::U8:
+        return U8;
+    case InferenceEngine::Precision::I8:
+        return I8;
+    case InferenceEngine::Precision::BOOL:
+        return BOOL;
+    case InferenceEngine::Precision::I32:
+        return I32;
+    case InferenceEngine::Precision::I64:
+        return I64;
+    case InferenceEngine::Precision::U64:
+        return U64;
+    default:
+        return UNSPECIFIED;
+    }
+}
+
+/**
+ * Dimensions of the tensor in the order of its layout, IE gives them in NCHW order for any layout
+ */
+static VShape toShape(const InferenceEngine::TensorDesc &desc) {
+    VShape shape = desc.getDims();
+    if (desc.getLayout() == InferenceEngine::NHWC && shape.size() == 4) {
+        shape = { shape[0], shape[2], shape[3], shape[1] };
+    }
+    return shape;
+}
+
+/**
+ * Wraps memory of the caller into IE blob of the tensor precision
+ */
+static InferenceEngine::Blob::Ptr wrapMemory(const InferenceEngine::TensorDesc &desc, void *data) {
+    using namespace InferenceEngine;
+    switch (desc.getPrecision()) {
+    case Precision::FP32:
+        return make_shared_blob<float>(desc, static_cast<float*>(data));
+    case Precision::FP16:
+    case Precision::BF16:
+    case Precision::I16:
+        return make_shared_blob<int16_t>(desc, static_cast<int16_t*>(data));
+    case Precision::U16:
+        return make_shared_blob<uint16_t>(desc, static_cast<uint16_t*>(data));
+    case Precision::U8:
+    case Precision::BOOL:
+        return make_shared_blob<uint8_t>(desc, static_cast<uint8_t*>(data));
+    case Precision::I8:
+        return make_shared_blob<int8_t>(desc, static_cast<int8_t*>(data));
+    case Precision::I32:
+        return make_shared_blob<int32_t>(desc, static_cast<int32_t*>(data));
+    case Precision::I64:
+        return make_shared_blob<int64_t>(desc, static_cast<int64_t*>(data));
+    case Precision::U64:
+        return make_shared_blob<uint64_t>(desc, static_cast<uint64_t*>(data));
+    default:
+        return nullptr;
+    }
+}
+
+/**
+ * Maps common backend keys to the keys of IE plugin for the device, the rest of keys are passed as is
+ */
+static std::map<std::string, std::string> toPluginConfig(const std::map<std::string, std::string> &config,
+                                                         const std::string &device) {
+    using namespace InferenceEngine;
+    std::map<std::string, std::string> pluginConfig;
+    for (auto &item : config) {
+        if (!BackendConfig::isCommonKey(item.first)) {
+            pluginConfig.insert(item);
+        }
+    }
+
+    bool cpu = device.find("CPU") == 0;
+    bool gpu = device.find("GPU") == 0;
+    std::string threads = getConfigValue<std::string>(config, BackendConfig::INFERENCE_THREADS, "");
+    std::string streams = getConfigValue<std::string>(config, BackendConfig::STREAMS, "");
+    std::string bind = getConfigValue<std::string>(config, BackendConfig::CPU_BIND, "");
+    std::string profile = getConfigValue<std::string>(config, BackendConfig::PERFORMANCE_PROFILE, "");
+
+    // plugin picks the number of streams itself for throughput profile if it is not given explicitly
+    if ((streams.empty() || streams == "0") && profile == BackendConfig::PROFILE_THROUGHPUT) {
+        streams = cpu ? PluginConfigParams::CPU_THROUGHPUT_AUTO : PluginConfigParams::GPU_THROUGHPUT_AUTO;
+    }
+    if (cpu) {
+        if (!threads.empty() && threads != "0") {
+            pluginConfig[PluginConfigParams::KEY_CPU_THREADS_NUM] = threads;
+        }
+        if (!streams.empty() && streams != "0") {
+            pluginConfig[PluginConfigParams::KEY_CPU_THROUGHPUT_STREAMS] = streams;
+        }
+        if (!bind.empty()) {
+            // NUMA is IE specific value and is passed as is
+            pluginConfig[PluginConfigParams::KEY_CPU_BIND_THREAD] = bind;
+        }
+    } else if (gpu) {
+        if (!streams.empty() && streams != "0") {
+            pluginConfig[PluginConfigParams::KEY_GPU_THROUGHPUT_STREAMS] = streams;
+        }
+    }
+    if (getConfigValue<std::string>(config, BackendConfig::PROFILING, BackendConfig::NO) == BackendConfig::YES) {
+        pluginConfig[PluginConfigParams::KEY_PERF_COUNT] = PluginConfigParams::YES;
+    }
+    return pluginConfig;
+}
+
+/**
+ * Backend option, directory where compiled networks are exported to and imported from on the next load
+ */
+static const char NETWORK_CACHE_DIR[] = "NETWORK_CACHE_DIR";
+/**
+ * Backend option, precision of image (4D) inputs: FP32 (default) makes the app convert and normalize pixels,
+ * U8 lets the plugin convert them itself, the app cannot normalize them then. Other inputs and outputs keep
+ * precisions of the network
+ */
+static const char IMAGE_PRECISION[] = "IMAGE_PRECISION";
+
+/**
+ * FNV-1a hash, continues hashing from the given value
+ */
+static uint64_t fnv1a(uint64_t hash, const char *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ static_cast<uint8_t>(data[i])) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static uint64_t hashFile(uint64_t hash, const std::string &fileName) {
+    std::ifstream file(fileName, std::ios::binary);
+    std::vector<char> buffer(1 << 20);
+    while (file) {
+        file.read(buffer.data(), buffer.size());
+        hash = fnv1a(hash, buffer.data(), static_cast<size_t>(file.gcount()));
+    }
+    return hash;
+}
+
+/**
+ * Compiled network depends on content of the model, device and plugin configuration
+ */
+static std::string networkCacheKey(const std::string &model, const std::string &weights, const std::string &device,
+                                   const std::map<std::string, std::string> &pluginConfig) {
+    uint64_t hash = 14695981039346656037ull;
+    hash = hashFile(hash, model);
+    hash = hashFile(hash, weights);
+    hash = fnv1a(hash, device.c_str(), device.size() + 1);
+    for (auto &item : pluginConfig) {
+        hash = fnv1a(hash, item.first.c_str(), item.first.size() + 1);
+        hash = fnv1a(hash, item.second.c_str(), item.second.size() + 1);
+    }
+    std::ostringstream key;
+    key << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return key.str();
+}
+
+static void makeDirectory(const std::string &path) {
+#if defined(_WIN32)
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
 bool IEBackend::loadModel(const std::string &model, const std::string &device,
                           const std::vector<std::string> &outputs,
                           const std::map<std::string, std::string>& config) {
 
     try {
-        InferenceEngine::CNNNetwork network = _core.ReadNetwork(model, model.substr(0, model.size() - 4) + ".bin");
-        InferenceEngine::InputsDataMap inputInfo = network.getInputsInfo();
-        for (auto i : inputInfo) {
-            i.second->setPrecision(InferenceEngine::Precision::FP32);
-        }
-        InferenceEngine::OutputsDataMap outInfo = network.getOutputsInfo();
-        _executableNetwork = _core.LoadNetwork(network, device, config);
-        inferRequest = _executableNetwork.CreateInferRequest();
-        // go over inputs and outputs and create host memory blobs for them
-        for (auto i : inputInfo) {
-            auto dims = i.second->getTensorDesc().getDims();
-            size_t size = product(dims) * sizeof(float);
-            _blobs[i.first] = std::make_shared<VBlob>();
-            _blobs[i.first]->_shape = dims;
-            _blobs[i.first]->_data = (unsigned char *)malloc(size);
-            auto ieblob = InferenceEngine::make_shared_blob<float>(i.second->getTensorDesc(),
-                                                                   static_cast<float*>(_blobs[i.first]->_data), product(dims));
-            inferRequest.SetBlob(i.first, ieblob);
+        std::string weights = model.substr(0, model.size() - 4) + ".bin";
+        std::map<std::string, std::string> pluginConfig = toPluginConfig(config, device);
+        // options of the backend, not of the plugin
+        pluginConfig.erase(NETWORK_CACHE_DIR);
+        pluginConfig.erase(IMAGE_PRECISION);
+        std::string imagePrecision = getConfigValue<std::string>(config, IMAGE_PRECISION, "FP32");
+        if (imagePrecision != "U8" && imagePrecision != "FP32") {
+            std::cerr << "Unknown " << IMAGE_PRECISION << " " << imagePrecision << ", U8 or FP32 is expected" << std::endl;
+            return false;
+        }
+        // plugin resizes images of any size set to the request, pixels are U8 BGR interleaved as they are decoded
+        bool preprocessing = getConfigValue<std::string>(config, BackendConfig::PREPROCESSING, BackendConfig::NO) ==
+                             BackendConfig::YES;
+        std::vector<float> mean = getChannelValues(config, BackendConfig::MEAN_VALUES);
+        std::vector<float> deviation = getChannelValues(config, BackendConfig::STD_VALUES);
+        if (preprocessing && !mean.empty() && deviation.empty()) {
+            deviation.assign(3, 1.f);
+        } else if (preprocessing && mean.empty() && !deviation.empty()) {
+            mean.assign(3, 0.f);
+        }
+        std::string cacheDir = getConfigValue<std::string>(config, NETWORK_CACHE_DIR, "");
+        std::string cacheFile;
+        if (!cacheDir.empty()) {
+            makeDirectory(cacheDir);
+            // precision and preprocessing of inputs are compiled into the network
+            std::map<std::string, std::string> keyConfig = pluginConfig;
+            keyConfig[IMAGE_PRECISION] = imagePrecision;
+            keyConfig[BackendConfig::PREPROCESSING] = preprocessing ? BackendConfig::YES : BackendConfig::NO;
+            for (const char *key : { BackendConfig::MEAN_VALUES, BackendConfig::STD_VALUES }) {
+                auto value = config.find(key);
+                if (preprocessing && value != config.end()) {
+                    keyConfig.insert(*value);
+                }
+            }
+            cacheFile = cacheDir + "/" + networkCacheKey(model, weights, device, keyConfig) + ".blob";
+        }
 
-            IOInfo info;
-            switch(i.second->getTensorDesc().getPrecision()) {
-            case InferenceEngine::Precision::FP32:
-                info._precision = FP32;
-            default:
-                info._precision = UNSPECIFIED;
+        bool imported = false;
+        if (!cacheFile.empty() && std::ifstream(cacheFile).good()) {
+            try {
+                _executableNetwork = _core.ImportNetwork(cacheFile, device, pluginConfig);
+                imported = true;
+                _cacheStatus = "imported from " + cacheFile;
+            } catch (std::exception &ex) {
+                // stale or incompatible file, it is overwritten by the compiled network below
+                _cacheStatus = std::string("cannot be imported: ") + ex.what();
+            }
+        }
+        if (!imported) {
+            InferenceEngine::CNNNetwork network = _core.ReadNetwork(model, weights);
+            for (auto i : network.getInputsInfo()) {
+                if (i.second->getTensorDesc().getDims().size() != 4) {
+                    continue;
+                }
+                if (preprocessing && i.second->getTensorDesc().getDims()[0] == 1) {
+                    i.second->setPrecision(InferenceEngine::Precision::U8);
+                    i.second->setLayout(InferenceEngine::NHWC);
+                    i.second->getPreProcess().setResizeAlgorithm(InferenceEngine::RESIZE_BILINEAR);
+                    i.second->getPreProcess().setColorFormat(InferenceEngine::ColorFormat::BGR);
+                    if (!mean.empty()) {
+                        // channels of the network are in BGR order, values are given for R, G and B
+                        InferenceEngine::PreProcessInfo &info = i.second->getPreProcess();
+                        info.init(3);
+                        for (size_t c = 0; c < 3; c++) {
+                            info[c]->meanValue = mean[2 - c];
+                            info[c]->stdScale = deviation[2 - c];
+                        }
+                        info.setVariant(InferenceEngine::MEAN_VALUE);
+                    }
+                } else {
+                    // with U8 the plugin converts pixels in its kernels, host memory traffic of input is 4 times less
+                    i.second->setPrecision(imagePrecision == "U8" ? InferenceEngine::Precision::U8
+                                                                  : InferenceEngine::Precision::FP32);
+                }
             }
+            _executableNetwork = _core.LoadNetwork(network, device, pluginConfig);
+            if (!cacheFile.empty()) {
+                try {
+                    _executableNetwork.Export(cacheFile);
+                    _cacheStatus = "compiled and exported to " + cacheFile;
+                } catch (std::exception &ex) {
+                    _cacheStatus = std::string("compiled, plugin cannot export it: ") + ex.what();
+                }
+            }
+        }
+        _profiling = getConfigValue<std::string>(config, BackendConfig::PROFILING, BackendConfig::NO) == BackendConfig::YES;
 
-            info._shape = dims;
+        // executable network describes inputs and outputs the same way for compiled and imported network
+        for (auto i : _executableNetwork.GetInputsInfo()) {
+            IOInfo info;
+            info._precision = toPrecision(i.second->getTensorDesc().getPrecision());
+            info._shape = toShape(i.second->getTensorDesc());
+            // imported network might come without preprocessing, then the app resizes images itself
+            info._anyImageSize = i.second->getPreProcess().getResizeAlgorithm() != InferenceEngine::NO_RESIZE;
             _inputInfo[i.first] = info;
+            _tensorDescs[i.first] = i.second->getTensorDesc();
         }
-        for (auto o : outInfo) {
-            auto dims = o.second->getTensorDesc().getDims();
-            size_t size = product(dims) * sizeof(float);
-            _blobs[o.first] = std::make_shared<VBlob>();
-            _blobs[o.first]->_shape = dims;
-            _blobs[o.first]->_data = (unsigned char *)malloc(size);
-            auto ieblob = InferenceEngine::make_shared_blob<float>(o.second->getTensorDesc(),
-                                                                   static_cast<float *>(_blobs[o.first]->_data), product(dims));
-            inferRequest.SetBlob(o.first, ieblob);
-
+        for (auto o : _executableNetwork.GetOutputsInfo()) {
             IOInfo info;
-            switch (o.second->getTensorDesc().getPrecision()) {
-            case InferenceEngine::Precision::FP32:
-                info._precision = FP32;
-            default:
-                info._precision = UNSPECIFIED;
-            }
-
-            info._shape = dims;
+            info._precision = toPrecision(o.second->getTensorDesc().getPrecision());
+            info._shape = toShape(o.second->getTensorDesc());
             _outputInfo[o.first] = info;
+            _tensorDescs[o.first] = o.second->getTensorDesc();
+        }
 
-
+        // plugin knows how many requests keep all its streams busy
+        size_t nireq = getConfigValue<size_t>(config, BackendConfig::REQUESTS_NUM, 0);
+        if (nireq == 0) {
+            try {
+                nireq = _executableNetwork.GetMetric(METRIC_KEY(OPTIMAL_NUMBER_OF_INFER_REQUESTS)).as<unsigned int>();
+            } catch (std::exception&) {
+                // metric is not supported by the plugin
+            }
         }
+        createRequests(std::max<size_t>(1, nireq));
     } catch (std::exception & ex) {
         return false;
     }
@@ -68,32 +313,217 @@ bool IEBackend::loadModel(const std::string &model, const std::string &device,
     return true;
 }
 
+void IEBackend::createRequests(size_t nireq) {
+    // handles are indices of tensors in the order of _tensorDescs
+    _handles.clear();
+    for (auto &desc : _tensorDescs) {
+        _handles.emplace(desc.first, _handles.size());
+    }
+
+    _requests.resize(nireq);
+    _started.assign(nireq, false);
+    _profiles.assign(nireq, std::map<std::string, LayerProfile>());
+    _blobs.assign(nireq, std::vector<std::shared_ptr<VBlob> >(_handles.size()));
+    for (size_t r = 0; r < nireq; r++) {
+        _requests[r] = _executableNetwork.CreateInferRequest();
+        _requests[r].SetCompletionCallback<std::function<void(InferenceEngine::InferRequest, InferenceEngine::StatusCode)>>(
+            [this, r](InferenceEngine::InferRequest, InferenceEngine::StatusCode code) {
+                if (_callback) {
+                    _callback(r, code == InferenceEngine::StatusCode::OK);
+                }
+            });
+        // go over inputs and outputs and create host memory blobs for them
+        for (auto &desc : _tensorDescs) {
+            createBlob(r, desc.first, desc.second);
+        }
+    }
+}
+
+void IEBackend::createBlob(size_t request, const std::string &name, const InferenceEngine::TensorDesc &desc) {
+    // plugin allocates blobs with its preferred alignment, for some devices it is memory the plugin infers in
+    InferenceEngine::MemoryBlob::Ptr ieblob = InferenceEngine::as<InferenceEngine::MemoryBlob>(_requests[request].GetBlob(name));
+    if (!ieblob) {
+        throw std::runtime_error("Blob " + name + " is not in host memory");
+    }
+    auto vblob = std::make_shared<VBlob>();
+    vblob->_shape = toShape(desc);
+    vblob->_precision = toPrecision(desc.getPrecision());
+    if (desc.getLayout() == InferenceEngine::NHWC) {
+        vblob->_layout = NHWC;
+    }
+    // memory of host blobs stays mapped, it is valid while the blob is set to the request
+    vblob->borrow(ieblob->rwmap().as<void*>());
+    _blobs[request][_handles.at(name)] = vblob;
+}
+
 void IEBackend::report(const InferenceMetrics &im) const {
+    if (!_cacheStatus.empty()) {
+        std::cout << "Network cache: " << _cacheStatus << std::endl;
+    }
+    if (_profiling) {
+        printProfile(std::cout, getProfile());
+    }
+}
+
+void IEBackend::collectProfile(size_t request) {
+    if (!_profiling) {
+        return;
+    }
+    for (auto &counter : _requests[request].GetPerformanceCounts()) {
+        if (counter.second.status == InferenceEngine::InferenceEngineProfileInfo::EXECUTED) {
+            addLayerTime(_profiles[request], counter.first, counter.second.layer_type,
+                         counter.second.realTime_uSec / 1000.);
+        }
+    }
+}
 
+VProfile IEBackend::getProfile() const {
+    std::vector<const std::map<std::string, LayerProfile>*> profiles;
+    for (auto &profile : _profiles) {
+        profiles.push_back(&profile);
+    }
+    return mergeProfiles(profiles);
 }
+
 bool IEBackend::infer() {
     try {
-        inferRequest.Infer();
+        _requests[0].Infer();
+        collectProfile(0);
         return true;
     } catch (std::exception&) {
         return false;
     }
 }
 
+size_t IEBackend::getRequestsNum() const {
+    return _requests.size();
+}
+
+bool IEBackend::startAsync(size_t request) {
+    try {
+        _requests.at(request).StartAsync();
+        _started[request] = true;
+        return true;
+    } catch (std::exception&) {
+        return false;
+    }
+}
+
+bool IEBackend::wait(size_t request) {
+    try {
+        bool status = _requests.at(request).Wait(InferenceEngine::IInferRequest::WaitMode::RESULT_READY) ==
+            InferenceEngine::StatusCode::OK;
+        // counters are taken once per started inference
+        if (status && _started[request]) {
+            collectProfile(request);
+        }
+        _started[request] = false;
+        return status;
+    } catch (std::exception&) {
+        return false;
+    }
+}
+
+void IEBackend::setCompletionCallback(CompletionCallback callback) {
+    _callback = callback;
+}
+
 std::shared_ptr<VBlob> IEBackend::getBlob(const std::string &name) {
-    return _blobs[name];
+    return getBlob(name, 0);
+}
+
+std::shared_ptr<VBlob> IEBackend::getBlob(const std::string &name, size_t request) {
+    TensorHandle handle = getTensorHandle(name);
+    if (handle == INVALID_TENSOR_HANDLE) {
+        return nullptr;
+    }
+    return _blobs.at(request)[handle];
+}
+
+TensorHandle IEBackend::getTensorHandle(const std::string &name) const {
+    auto it = _handles.find(name);
+    return it != _handles.end() ? it->second : INVALID_TENSOR_HANDLE;
+}
+
+VBlob* IEBackend::getBlob(TensorHandle handle, size_t request) {
+    return _blobs[request][handle].get();
 }
 
 
+bool IEBackend::bindBlob(const std::string &name, std::shared_ptr<VBlob> blob, size_t request) {
+    auto desc = _tensorDescs.find(name);
+    auto input = _inputInfo.find(name);
+    if (input != _inputInfo.end() && input->second._anyImageSize) {
+        return bindImage(name, blob, request);
+    }
+    if (request >= _requests.size() || desc == _tensorDescs.end() || !blob || !blob->_data ||
+        blob->_shape != toShape(desc->second) || blob->_precision != toPrecision(desc->second.getPrecision()) ||
+        !blob->_strides.empty()) {
+        return false;
+    }
+    try {
+        InferenceEngine::Blob::Ptr ieblob = wrapMemory(desc->second, blob->_data);
+        if (!ieblob) {
+            return false;
+        }
+        _requests[request].SetBlob(name, ieblob);
+    } catch (std::exception&) {
+        return false;
+    }
+    _blobs[request][_handles.at(name)] = blob;
+    return true;
+}
+
+bool IEBackend::bindImage(const std::string &name, std::shared_ptr<VBlob> blob, size_t request) {
+    const InferenceEngine::SizeVector &dims = _tensorDescs.at(name).getDims();
+    if (request >= _requests.size() || !blob || !blob->_data || blob->_precision != U8 || blob->_layout != NHWC ||
+        blob->_colourFormat != BGR || blob->_shape.size() != 4 || blob->_shape[0] != dims[0] ||
+        blob->_shape[3] != dims[1] || !blob->_strides.empty()) {
+        return false;
+    }
+    try {
+        // dimensions of IE blob are NCHW for any layout, plugin resizes the image to the network input
+        InferenceEngine::TensorDesc desc(InferenceEngine::Precision::U8,
+                                         { blob->_shape[0], blob->_shape[3], blob->_shape[1], blob->_shape[2] },
+                                         InferenceEngine::NHWC);
+        _requests[request].SetBlob(name, InferenceEngine::make_shared_blob<uint8_t>(desc, static_cast<uint8_t*>(blob->_data)));
+    } catch (std::exception&) {
+        return false;
+    }
+    _blobs[request][_handles.at(name)] = blob;
+    return true;
+}
+
+Backend* IEBackend::createReplica() {
+    if (_requests.empty()) {
+        return nullptr;
+    }
+    // all infer requests created from the same executable network share its weights
+    IEBackend* replica = new IEBackend();
+    replica->_allocator = _allocator;
+    replica->_executableNetwork = _executableNetwork;
+    replica->_tensorDescs = _tensorDescs;
+    replica->_inputInfo = _inputInfo;
+    replica->_outputInfo = _outputInfo;
+    replica->_profiling = _profiling;
+    try {
+        replica->createRequests(_requests.size());
+    } catch (std::exception&) {
+        delete replica;
+        return nullptr;
+    }
+    return replica;
+}
+
 void IEBackend::release() {
     delete this;
 }
 
-VInputInfo IEBackend::getInputDataMap() const {
+const VInputInfo& IEBackend::getInputDataMap() const {
     return _inputInfo;
 }
 
-VOutputInfo IEBackend::getOutputDataMap() const {
+const VOutputInfo& IEBackend::getOutputDataMap() const {
     return _outputInfo;
 }
 
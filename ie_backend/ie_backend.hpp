@@ -18,19 +18,47 @@ public:
         return nullptr;
     }
     virtual void report(const InferenceMetrics &im) const override;
+    virtual VProfile getProfile() const override;
     virtual bool infer()override;
+    virtual Backend* createReplica()override;
     virtual void release()override;
 
+    virtual size_t getRequestsNum() const override;
+    virtual bool startAsync(size_t request)override;
+    virtual bool wait(size_t request)override;
+    virtual void setCompletionCallback(CompletionCallback callback)override;
+
     virtual std::shared_ptr<VBlob> getBlob(const std::string &name)override;
+    virtual std::shared_ptr<VBlob> getBlob(const std::string &name, size_t request)override;
+    virtual TensorHandle getTensorHandle(const std::string &name) const override;
+    virtual VBlob* getBlob(TensorHandle handle, size_t request)override;
+    virtual bool bindBlob(const std::string &name, std::shared_ptr<VBlob> blob, size_t request)override;
 
-    virtual VInputInfo getInputDataMap() const override;
-    virtual VOutputInfo getOutputDataMap() const override;
+    virtual const VInputInfo& getInputDataMap() const override;
+    virtual const VOutputInfo& getOutputDataMap() const override;
 
 protected:
+    void createRequests(size_t nireq);
+    void createBlob(size_t request, const std::string &name, const InferenceEngine::TensorDesc &desc);
+    void collectProfile(size_t request);
+    // binds decoded image of any size to the input resized by the plugin
+    bool bindImage(const std::string &name, std::shared_ptr<VBlob> blob, size_t request);
+
     InferenceEngine::Core _core;
     InferenceEngine::ExecutableNetwork _executableNetwork;
-    InferenceEngine::InferRequest inferRequest;
-    std::map<std::string, std::shared_ptr<VBlob> > _blobs;
+    std::map<std::string, InferenceEngine::TensorDesc> _tensorDescs;
+    std::vector<InferenceEngine::InferRequest> _requests;
+    std::map<std::string, TensorHandle> _handles;
+    // blobs of each infer request indexed by tensor handle
+    std::vector<std::vector<std::shared_ptr<VBlob> > > _blobs;
+    CompletionCallback _callback;
+    // performance counters of every request accumulated after each inference
+    bool _profiling = false;
+    std::vector<bool> _started;
+    std::vector<std::map<std::string, LayerProfile> > _profiles;
+
+    // how the network was taken from NETWORK_CACHE_DIR, empty if cache is not used
+    std::string _cacheStatus;
 
     VInputInfo _inputInfo;
     VOutputInfo _outputInfo;
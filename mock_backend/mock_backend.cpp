@@ -0,0 +1,363 @@
+// Copyright 2021 the dldt tools authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+
+#include "mock_backend.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+static const char INPUT_SHAPE[] = "INPUT_SHAPE";
+static const char INPUT_PRECISION[] = "INPUT_PRECISION";
+static const char INPUT_LAYOUT[] = "INPUT_LAYOUT";
+static const char OUTPUT_KIND[] = "OUTPUT_KIND";
+static const char CLASSES[] = "CLASSES";
+static const char DETECTIONS[] = "DETECTIONS";
+static const char LATENCY_US[] = "LATENCY_US";
+static const char LATENCY_JITTER_US[] = "LATENCY_JITTER_US";
+static const char LATENCY_WAIT[] = "LATENCY_WAIT";
+
+static const char INPUT_NAME[] = "data";
+static const char CLASSIFICATION_OUTPUT_NAME[] = "prob";
+static const char SSD_OUTPUT_NAME[] = "detection_out";
+// image_id, label, confidence, xmin, ymin, xmax, ymax
+static const size_t SSD_OBJECT_SIZE = 7;
+
+typedef std::chrono::steady_clock Clock;
+
+bool MockBackend::loadModel(const std::string &model, const std::string &device,
+                            const std::vector<std::string> &outputs,
+                            const std::map<std::string, std::string> &config) {
+    try {
+        // --------------------------- 1. Declare input --------------------------------------------------------
+        IOInfo input;
+        input._shape = {1, 3, 224, 224};
+        std::string shape = getConfigValue<std::string>(config, INPUT_SHAPE, "");
+        if (!shape.empty()) {
+            input._shape.clear();
+            std::istringstream stream(shape);
+            std::string dim;
+            while (std::getline(stream, dim, ',')) {
+                input._shape.push_back(std::stoul(dim));
+            }
+        }
+        std::string precision = getConfigValue<std::string>(config, INPUT_PRECISION, "FP32");
+        if (precision == "FP32") {
+            input._precision = FP32;
+        } else if (precision == "U8") {
+            input._precision = U8;
+        } else {
+            std::cerr << "Unknown " << INPUT_PRECISION << " " << precision << ", FP32 or U8 is expected" << std::endl;
+            return false;
+        }
+        std::string layout = getConfigValue<std::string>(config, INPUT_LAYOUT, "NCHW");
+        if (layout == "NCHW" || layout == "NHWC") {
+            _inputLayout = layout == "NCHW" ? NCHW : NHWC;
+        } else {
+            std::cerr << "Unknown " << INPUT_LAYOUT << " " << layout << ", NCHW or NHWC is expected" << std::endl;
+            return false;
+        }
+        if (input._shape.size() != 4 || product(input._shape) == 0) {
+            std::cerr << "4D " << INPUT_SHAPE << " is expected" << std::endl;
+            return false;
+        }
+        _inputInfo[INPUT_NAME] = input;
+        _handles[INPUT_NAME] = 0;
+
+        // --------------------------- 2. Declare output -------------------------------------------------------
+        std::string kind = getConfigValue<std::string>(config, OUTPUT_KIND, "CLASSIFICATION");
+        size_t batch = input._shape[0];
+        IOInfo output;
+        output._precision = FP32;
+        if (kind == "CLASSIFICATION") {
+            _outputKind = kClassification;
+            _classes = getConfigValue<size_t>(config, CLASSES, 1000);
+            output._shape = {batch, _classes};
+            _outputInfo[CLASSIFICATION_OUTPUT_NAME] = output;
+            _handles[CLASSIFICATION_OUTPUT_NAME] = 1;
+        } else if (kind == "SSD") {
+            _outputKind = kSSD;
+            // VOC classes and background
+            _classes = getConfigValue<size_t>(config, CLASSES, 21);
+            _detections = getConfigValue<size_t>(config, DETECTIONS, 10);
+            output._shape = {1, 1, batch * _detections, SSD_OBJECT_SIZE};
+            _outputInfo[SSD_OUTPUT_NAME] = output;
+            _handles[SSD_OUTPUT_NAME] = 1;
+        } else {
+            std::cerr << "Unknown " << OUTPUT_KIND << " " << kind << ", CLASSIFICATION or SSD is expected" << std::endl;
+            return false;
+        }
+        if (_classes == 0) {
+            return false;
+        }
+        _probabilities.resize(_classes);
+        float sum = 0.f;
+        for (size_t k = 0; k < _classes; k++) {
+            _probabilities[k] = 1.f / ((k + 1) * (k + 1));
+            sum += _probabilities[k];
+        }
+        for (auto &p : _probabilities) {
+            p /= sum;
+        }
+
+        // --------------------------- 3. Configure execution --------------------------------------------------
+        _latency = getConfigValue<size_t>(config, LATENCY_US, 0);
+        _jitter = std::min(_latency, getConfigValue<size_t>(config, LATENCY_JITTER_US, 0));
+        std::string wait = getConfigValue<std::string>(config, LATENCY_WAIT, "SLEEP");
+        if (wait != "SLEEP" && wait != "SPIN") {
+            std::cerr << "Unknown " << LATENCY_WAIT << " " << wait << ", SLEEP or SPIN is expected" << std::endl;
+            return false;
+        }
+        _spin = wait == "SPIN";
+        _bindCores = getConfigValue<std::string>(config, BackendConfig::CPU_BIND, BackendConfig::NO) == BackendConfig::YES;
+        _profiling = getConfigValue<std::string>(config, BackendConfig::PROFILING, BackendConfig::NO) == BackendConfig::YES;
+        size_t nireq = std::max<size_t>(1, getConfigValue<size_t>(config, BackendConfig::REQUESTS_NUM, 1));
+        return createRequests(nireq);
+    } catch (std::exception &ex) {
+        std::cerr << ex.what() << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool MockBackend::createRequests(size_t nireq) {
+    try {
+        _requests.resize(nireq);
+        for (size_t r = 0; r < nireq; r++) {
+            Request &request = _requests[r];
+            const IOInfo &input = _inputInfo.begin()->second;
+            const IOInfo &output = _outputInfo.begin()->second;
+
+            auto inputBlob = std::make_shared<VBlob>();
+            inputBlob->_precision = input._precision;
+            inputBlob->_shape = input._shape;
+            inputBlob->_layout = _inputLayout;
+            inputBlob->allocate(inputBlob->byteSize(), _allocator);
+            memset(inputBlob->_data, 0, inputBlob->byteSize());
+
+            auto outputBlob = std::make_shared<VBlob>();
+            outputBlob->_precision = output._precision;
+            outputBlob->_shape = output._shape;
+            outputBlob->allocate(outputBlob->byteSize(), _allocator);
+
+            request.blobs = {inputBlob, outputBlob};
+            request.random.seed(static_cast<uint32_t>(r));
+
+            AsyncInferRequest::Init init = nullptr;
+            if (_bindCores) {
+                init = [r]() { pinCurrentThread(r); };
+            }
+            request.async.reset(new AsyncInferRequest([this, &request]() { return run(request); }, init));
+        }
+    } catch (std::exception &ex) {
+        std::cerr << ex.what() << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+uint32_t MockBackend::inputSeed(const VBlob &input, size_t batchIndex) {
+    // FNV-1a of 64 bytes evenly spread over the image
+    static const size_t SAMPLES = 64;
+    size_t imageSize = input.byteSize() / input._shape[0];
+    const uint8_t* image = static_cast<const uint8_t*>(input._data) + batchIndex * imageSize;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < SAMPLES; i++) {
+        hash = (hash ^ image[i * imageSize / SAMPLES]) * 16777619u;
+    }
+    return hash;
+}
+
+void MockBackend::fillClassification(const VBlob &input, VBlob &output) const {
+    float* prob = static_cast<float*>(output._data);
+    for (size_t b = 0; b < output._shape[0]; b++) {
+        float* row = prob + b * _classes;
+        size_t top = inputSeed(input, b) % _classes;
+        // row[(top + k) % classes] = probabilities[k]
+        std::copy(_probabilities.begin(), _probabilities.end() - top, row + top);
+        std::copy(_probabilities.end() - top, _probabilities.end(), row);
+    }
+}
+
+void MockBackend::fillDetections(const VBlob &input, VBlob &output) const {
+    float* box = static_cast<float*>(output._data);
+    size_t batch = input._shape[0];
+    for (size_t b = 0; b < batch; b++) {
+        uint32_t seed = inputSeed(input, b);
+        for (size_t d = 0; d < _detections; d++) {
+            // linear congruential generator gives box coordinates, confidence decreases with index
+            seed = seed * 1664525u + 1013904223u;
+            float xmin = (seed % 512) / 1024.f;
+            float ymin = ((seed >> 9) % 512) / 1024.f;
+            float width = 0.1f + ((seed >> 18) % 400) / 1000.f;
+            float height = 0.1f + ((seed >> 23) % 400) / 1000.f;
+
+            float* object = box + (b * _detections + d) * SSD_OBJECT_SIZE;
+            object[0] = static_cast<float>(b);
+            object[1] = static_cast<float>(_classes > 1 ? 1 + seed % (_classes - 1) : 0);
+            object[2] = 1.f - 0.9f * d / _detections;
+            object[3] = xmin;
+            object[4] = ymin;
+            object[5] = std::min(1.f, xmin + width);
+            object[6] = std::min(1.f, ymin + height);
+        }
+    }
+}
+
+bool MockBackend::run(Request &request) {
+    Clock::time_point start = Clock::now();
+    size_t latency = _latency;
+    if (_jitter) {
+        latency = std::uniform_int_distribution<size_t>(_latency - _jitter, _latency + _jitter)(request.random);
+    }
+    Clock::time_point deadline = start + std::chrono::microseconds(latency);
+
+    const VBlob &input = *request.blobs[0];
+    VBlob &output = *request.blobs[1];
+    if (_outputKind == kClassification) {
+        fillClassification(input, output);
+    } else {
+        fillDetections(input, output);
+    }
+    Clock::time_point filled = Clock::now();
+
+    // time of synthesis is a part of simulated latency
+    if (_spin) {
+        while (Clock::now() < deadline) {
+        }
+    } else {
+        std::this_thread::sleep_until(deadline);
+    }
+
+    if (_profiling) {
+        typedef std::chrono::duration<double, std::milli> ms;
+        addLayerTime(request.profile, "outputs", "Synthesis", std::chrono::duration_cast<ms>(filled - start).count());
+        addLayerTime(request.profile, "latency", _spin ? "Spin" : "Sleep",
+                     std::chrono::duration_cast<ms>(Clock::now() - filled).count());
+    }
+    return true;
+}
+
+void MockBackend::report(const InferenceMetrics &im) const {
+    if (_profiling) {
+        printProfile(std::cout, getProfile());
+    }
+}
+
+VProfile MockBackend::getProfile() const {
+    std::vector<const std::map<std::string, LayerProfile>*> profiles;
+    for (auto &request : _requests) {
+        profiles.push_back(&request.profile);
+    }
+    return mergeProfiles(profiles);
+}
+
+bool MockBackend::infer() {
+    return run(_requests[0]);
+}
+
+size_t MockBackend::getRequestsNum() const {
+    return _requests.size();
+}
+
+bool MockBackend::startAsync(size_t request) {
+    if (request >= _requests.size()) {
+        return false;
+    }
+    return _requests[request].async->start([this, request](bool status) {
+        if (_callback) {
+            _callback(request, status);
+        }
+    });
+}
+
+bool MockBackend::wait(size_t request) {
+    if (request >= _requests.size()) {
+        return false;
+    }
+    return _requests[request].async->wait();
+}
+
+void MockBackend::setCompletionCallback(CompletionCallback callback) {
+    _callback = callback;
+}
+
+std::shared_ptr<VBlob> MockBackend::getBlob(const std::string &name) {
+    return getBlob(name, 0);
+}
+
+std::shared_ptr<VBlob> MockBackend::getBlob(const std::string &name, size_t request) {
+    TensorHandle handle = getTensorHandle(name);
+    if (handle == INVALID_TENSOR_HANDLE) {
+        return nullptr;
+    }
+    return _requests.at(request).blobs[handle];
+}
+
+TensorHandle MockBackend::getTensorHandle(const std::string &name) const {
+    auto it = _handles.find(name);
+    return it != _handles.end() ? it->second : INVALID_TENSOR_HANDLE;
+}
+
+VBlob* MockBackend::getBlob(TensorHandle handle, size_t request) {
+    return _requests[request].blobs[handle].get();
+}
+
+bool MockBackend::bindBlob(const std::string &name, std::shared_ptr<VBlob> blob, size_t request) {
+    TensorHandle handle = getTensorHandle(name);
+    if (request >= _requests.size() || handle == INVALID_TENSOR_HANDLE || !blob || !blob->_data) {
+        return false;
+    }
+    const VBlob* current = _requests[request].blobs[handle].get();
+    if (blob->_precision != current->_precision || blob->_shape != current->_shape || !blob->_strides.empty()) {
+        return false;
+    }
+    _requests[request].blobs[handle] = blob;
+    return true;
+}
+
+Backend* MockBackend::createReplica() {
+    if (_requests.empty()) {
+        return nullptr;
+    }
+    MockBackend* replica = new MockBackend();
+    replica->_allocator = _allocator;
+    replica->_inputInfo = _inputInfo;
+    replica->_outputInfo = _outputInfo;
+    replica->_handles = _handles;
+    replica->_inputLayout = _inputLayout;
+    replica->_outputKind = _outputKind;
+    replica->_classes = _classes;
+    replica->_detections = _detections;
+    replica->_latency = _latency;
+    replica->_jitter = _jitter;
+    replica->_spin = _spin;
+    replica->_bindCores = _bindCores;
+    replica->_profiling = _profiling;
+    replica->_probabilities = _probabilities;
+    if (!replica->createRequests(_requests.size())) {
+        delete replica;
+        return nullptr;
+    }
+    return replica;
+}
+
+void MockBackend::release() {
+    delete this;
+}
+
+const VInputInfo& MockBackend::getInputDataMap() const {
+    return _inputInfo;
+}
+
+const VOutputInfo& MockBackend::getOutputDataMap() const {
+    return _outputInfo;
+}
+
+Backend* createBackend() {
+    return new MockBackend();
+}
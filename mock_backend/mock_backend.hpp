@@ -0,0 +1,95 @@
+// Copyright 2021 the dldt tools authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+
+#include "backend.hpp"
+#include "async_infer_request.hpp"
+
+#include <random>
+
+extern "C" {
+Backend* createBackend();
+}
+
+/**
+ * Backend without model runtime for measuring the host side of the pipeline (decoding, preprocessing,
+ * postprocessing, metrics). Model file is not read, tensors are declared by the config and outputs are synthesized
+ * from the input, so the same image always gets the same result. Backend specific config keys:
+ *   INPUT_SHAPE       - comma separated shape of the input, 1,3,224,224 by default
+ *   INPUT_PRECISION   - FP32 (default) or U8
+ *   INPUT_LAYOUT      - NCHW (default) or NHWC
+ *   OUTPUT_KIND       - CLASSIFICATION (default) gives [N, CLASSES] probabilities,
+ *                       SSD gives [1, 1, N * DETECTIONS, 7] DetectionOutput
+ *   CLASSES           - number of classes, 1000 by default
+ *   DETECTIONS        - number of detections per image, 10 by default
+ *   LATENCY_US        - simulated inference time, 0 by default
+ *   LATENCY_JITTER_US - time is uniformly distributed in LATENCY_US +- LATENCY_JITTER_US, 0 (fixed time) by default
+ *   LATENCY_WAIT      - SLEEP (default) releases the core, SPIN keeps it busy as a real inference does
+ */
+class MockBackend : public Backend {
+public:
+    virtual bool loadModel(const std::string &model, const std::string &device,
+                           const std::vector<std::string> &outputs,
+                           const std::map<std::string, std::string>& config)override;
+    virtual std::shared_ptr<InferenceMetrics> process(bool streamOutput = false)override
+    {
+        return nullptr;
+    }
+    virtual void report(const InferenceMetrics &im) const override;
+    virtual VProfile getProfile() const override;
+    virtual bool infer()override;
+    virtual Backend* createReplica()override;
+    virtual void release()override;
+
+    virtual size_t getRequestsNum() const override;
+    virtual bool startAsync(size_t request)override;
+    virtual bool wait(size_t request)override;
+    virtual void setCompletionCallback(CompletionCallback callback)override;
+
+    virtual std::shared_ptr<VBlob> getBlob(const std::string &name)override;
+    virtual std::shared_ptr<VBlob> getBlob(const std::string &name, size_t request)override;
+    virtual TensorHandle getTensorHandle(const std::string &name) const override;
+    virtual VBlob* getBlob(TensorHandle handle, size_t request)override;
+    virtual bool bindBlob(const std::string &name, std::shared_ptr<VBlob> blob, size_t request)override;
+
+    virtual const VInputInfo& getInputDataMap() const override;
+    virtual const VOutputInfo& getOutputDataMap() const override;
+
+protected:
+    enum OutputKind { kClassification, kSSD };
+
+    struct Request {
+        // input and output, indexed by tensor handle
+        std::vector<std::shared_ptr<VBlob> > blobs;
+        // latency of requests is random but reproducible, every request has own generator
+        std::mt19937 random;
+        std::map<std::string, LayerProfile> profile;
+        std::unique_ptr<AsyncInferRequest> async;
+    };
+
+    bool createRequests(size_t nireq);
+    bool run(Request &request);
+    // the same input gives the same value, a few samples of the input are enough for it
+    static uint32_t inputSeed(const VBlob &input, size_t batchIndex);
+    void fillClassification(const VBlob &input, VBlob &output) const;
+    void fillDetections(const VBlob &input, VBlob &output) const;
+
+    VInputInfo _inputInfo;
+    VOutputInfo _outputInfo;
+    std::map<std::string, TensorHandle> _handles;
+
+    CompletionCallback _callback;
+    evLayout _inputLayout = NCHW;
+    OutputKind _outputKind = kClassification;
+    size_t _classes = 1000;
+    size_t _detections = 10;
+    size_t _latency = 0;  // us
+    size_t _jitter = 0;   // us
+    bool _spin = false;
+    bool _bindCores = false;
+    bool _profiling = false;
+    // probabilities sorted in descending order, rotated to put the top one at the class chosen by input
+    std::vector<float> _probabilities;
+    // worker threads of requests must be stopped before blobs are destroyed,
+    // async member is declared last in Request for this
+    std::vector<Request> _requests;
+};
@@ -0,0 +1,394 @@
+// Copyright 2021 the dldt tools authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+
+#include "onnxruntime_backend.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+static const char INTER_OP_THREADS[] = "INTER_OP_THREADS";
+static const char GRAPH_OPTIMIZATION_LEVEL[] = "GRAPH_OPTIMIZATION_LEVEL";
+
+static evPrecision toPrecision(ONNXTensorElementDataType type) {
+    switch (type) {
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
+        return FP32;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16:
+        return FP16;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8:
+        return U8;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT8:
+        return I8;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32:
+        return I32;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64:
+        return I64;
+    default:
+        return UNSPECIFIED;
+    }
+}
+
+bool ONNXRuntimeBackend::loadModel(const std::string &model, const std::string &device,
+                                   const std::vector<std::string> &outputs,
+                                   const std::map<std::string, std::string> &config) {
+    try {
+        // --------------------------- 1. Configure session ----------------------------------------------------
+        Ort::SessionOptions options;
+        // ORT decides on the number of threads if it is 0
+        options.SetIntraOpNumThreads(std::max(0, getConfigValue<int>(config, BackendConfig::INFERENCE_THREADS, 0)));
+        int interOpThreads = getConfigValue<int>(config, INTER_OP_THREADS, 0);
+        if (interOpThreads > 0) {
+            options.SetExecutionMode(ORT_PARALLEL);
+            options.SetInterOpNumThreads(interOpThreads);
+        }
+        std::string level = getConfigValue<std::string>(config, GRAPH_OPTIMIZATION_LEVEL, "ALL");
+        if (level == "DISABLE_ALL") {
+            options.SetGraphOptimizationLevel(ORT_DISABLE_ALL);
+        } else if (level == "BASIC") {
+            options.SetGraphOptimizationLevel(ORT_ENABLE_BASIC);
+        } else if (level == "EXTENDED") {
+            options.SetGraphOptimizationLevel(ORT_ENABLE_EXTENDED);
+        } else if (level == "ALL") {
+            options.SetGraphOptimizationLevel(ORT_ENABLE_ALL);
+        } else {
+            std::cerr << "Unknown " << GRAPH_OPTIMIZATION_LEVEL << " " << level
+                      << ", DISABLE_ALL, BASIC, EXTENDED or ALL is expected" << std::endl;
+            return false;
+        }
+        _bindCores = getConfigValue<std::string>(config, BackendConfig::CPU_BIND, BackendConfig::NO) == BackendConfig::YES;
+        _profiling = getConfigValue<std::string>(config, BackendConfig::PROFILING, BackendConfig::NO) == BackendConfig::YES;
+        if (_profiling) {
+            options.EnableProfiling(ORT_TSTR("onnxruntime_profile"));
+        }
+
+        if (device == "GPU") {
+            OrtCUDAProviderOptions cudaOptions;
+            options.AppendExecutionProvider_CUDA(cudaOptions);
+        } else if (device != "CPU") {
+            std::cerr << "The device name is not valid. Please select CPU/GPU." << std::endl;
+            return false;
+        }
+
+        // --------------------------- 2. Create session -------------------------------------------------------
+        Ort::Env env(ORT_LOGGING_LEVEL_WARNING, "validation_app");
+        Ort::Session session(env, model.c_str(), options);
+        _model = std::make_shared<Model>(std::move(env), std::move(session));
+        Ort::Session &s = _model->session;
+
+        // --------------------------- 3. Collect inputs and outputs -------------------------------------------
+        Ort::AllocatorWithDefaultOptions allocator;
+        _inputsNum = s.GetInputCount();
+        std::vector<Ort::TypeInfo> typeInfos;
+        for (size_t i = 0; i < _inputsNum; i++) {
+            _names.push_back(s.GetInputNameAllocated(i, allocator).get());
+            typeInfos.push_back(s.GetInputTypeInfo(i));
+        }
+        for (size_t o = 0; o < s.GetOutputCount(); o++) {
+            std::string name = s.GetOutputNameAllocated(o, allocator).get();
+            if (outputs.empty() || std::find(outputs.begin(), outputs.end(), name) != outputs.end()) {
+                _names.push_back(name);
+                typeInfos.push_back(s.GetOutputTypeInfo(o));
+            }
+        }
+
+        for (size_t h = 0; h < _names.size(); h++) {
+            auto tensorInfo = typeInfos[h].GetTensorTypeAndShapeInfo();
+            IOInfo info;
+            info._precision = toPrecision(tensorInfo.GetElementType());
+            if (info._precision == UNSPECIFIED) {
+                std::cerr << "Unsupported type of " << _names[h] << std::endl;
+                return false;
+            }
+            std::vector<int64_t> shape = tensorInfo.GetShape();
+            bool dynamic = false;
+            for (size_t d = 0; d < shape.size(); d++) {
+                if (shape[d] > 0) {
+                    continue;
+                }
+                if (h < _inputsNum && d != 0) {
+                    std::cerr << "Only batch dimension of input " << _names[h] << " can be dynamic" << std::endl;
+                    return false;
+                }
+                // dynamic batch of inputs is inferred with 1, outputs get real dimensions after inference
+                shape[d] = 1;
+                dynamic = h >= _inputsNum;
+            }
+            info._shape.assign(shape.begin(), shape.end());
+            if (h < _inputsNum) {
+                _inputInfo[_names[h]] = info;
+            } else {
+                _outputInfo[_names[h]] = info;
+            }
+            _handles[_names[h]] = h;
+            _types.push_back(tensorInfo.GetElementType());
+            _shapes.push_back(shape);
+            _dynamic.push_back(dynamic);
+            _hasDynamic = _hasDynamic || dynamic;
+        }
+
+        size_t nireq = std::max<size_t>(1, getConfigValue<size_t>(config, BackendConfig::REQUESTS_NUM, 1));
+        return createRequests(nireq);
+    } catch (std::exception &ex) {
+        std::cerr << ex.what() << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool ONNXRuntimeBackend::createRequests(size_t nireq) {
+    try {
+        // requests share the session, every request binds own blobs
+        _requests.resize(nireq);
+        for (size_t r = 0; r < nireq; r++) {
+            Request &request = _requests[r];
+            request.binding.reset(new Ort::IoBinding(_model->session));
+            request.blobs.resize(_names.size());
+            for (size_t h = 0; h < _names.size(); h++) {
+                auto vblob = std::make_shared<VBlob>();
+                vblob->_precision = toPrecision(_types[h]);
+                vblob->_shape.assign(_shapes[h].begin(), _shapes[h].end());
+                if (_shapes[h].size() == 4 && _shapes[h][3] == 3 && _shapes[h][1] != 3) {
+                    vblob->_layout = NHWC;
+                    // quantized models converted from TF take RGB images
+                    if (vblob->_precision == U8) {
+                        vblob->_colourFormat = RGB;
+                    }
+                }
+                request.blobs[h] = vblob;
+                if (_dynamic[h]) {
+                    // session allocates output of the shape known after inference, blob borrows it
+                    request.values.emplace_back(nullptr);
+                    request.binding->BindOutput(_names[h].c_str(), _memoryInfo);
+                    continue;
+                }
+                vblob->allocate(vblob->byteSize(), _allocator);
+                request.values.push_back(Ort::Value::CreateTensor(_memoryInfo, vblob->_data, vblob->byteSize(),
+                                                                  _shapes[h].data(), _shapes[h].size(), _types[h]));
+                if (h < _inputsNum) {
+                    request.binding->BindInput(_names[h].c_str(), request.values[h]);
+                } else {
+                    request.binding->BindOutput(_names[h].c_str(), request.values[h]);
+                }
+            }
+
+            AsyncInferRequest::Init init = nullptr;
+            if (_bindCores) {
+                // calling thread takes part in execution, intra-op threads are owned by the session
+                init = [r]() { pinCurrentThread(r); };
+            }
+            request.async.reset(new AsyncInferRequest([this, &request]() { return run(request); }, init));
+        }
+    } catch (std::exception &ex) {
+        std::cerr << ex.what() << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool ONNXRuntimeBackend::run(Request &request) {
+    _model->session.Run(Ort::RunOptions(), *request.binding);
+    if (_hasDynamic) {
+        // values are in the order of binding, it is the order of handles
+        std::vector<Ort::Value> outputs = request.binding->GetOutputValues();
+        for (size_t o = 0; o < outputs.size(); o++) {
+            size_t h = _inputsNum + o;
+            if (!_dynamic[h]) {
+                continue;
+            }
+            std::vector<int64_t> shape = outputs[o].GetTensorTypeAndShapeInfo().GetShape();
+            VBlob* vblob = request.blobs[h].get();
+            vblob->_shape.assign(shape.begin(), shape.end());
+            vblob->borrow(outputs[o].GetTensorMutableData<void>());
+            request.values[h] = std::move(outputs[o]);
+        }
+    }
+    return true;
+}
+
+void ONNXRuntimeBackend::report(const InferenceMetrics &im) const {
+    if (_profiling) {
+        printProfile(std::cout, getProfile());
+    }
+}
+
+VProfile ONNXRuntimeBackend::getProfile() const {
+    if (!_profiling || !_model) {
+        return VProfile();
+    }
+    if (!_profile) {
+        // the trace is written when profiling of the session is stopped, replicas share it
+        Ort::AllocatorWithDefaultOptions allocator;
+        std::string fileName = _model->session.EndProfilingAllocated(allocator).get();
+        _profile.reset(new VProfile(readProfile(fileName)));
+    }
+    return *_profile;
+}
+
+/**
+ * @return value of the key in one line json object as written by ORT profiler, empty string if key is absent
+ */
+static std::string jsonValue(const std::string &line, const std::string &key) {
+    size_t pos = line.find("\"" + key + "\"");
+    if (pos == std::string::npos) {
+        return std::string();
+    }
+    pos = line.find_first_not_of(" :", pos + key.size() + 2);
+    if (pos == std::string::npos) {
+        return std::string();
+    }
+    if (line[pos] == '"') {
+        size_t end = line.find('"', pos + 1);
+        return end == std::string::npos ? std::string() : line.substr(pos + 1, end - pos - 1);
+    }
+    size_t end = line.find_first_of(",}", pos);
+    return line.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+}
+
+VProfile ONNXRuntimeBackend::readProfile(const std::string &fileName) {
+    // chrome trace, one event per line. Node events named <node>_kernel_time have duration of the kernel in us
+    static const std::string KERNEL_TIME = "_kernel_time";
+    std::map<std::string, LayerProfile> profile;
+    std::ifstream file(fileName);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (jsonValue(line, "cat") != "Node") {
+            continue;
+        }
+        std::string name = jsonValue(line, "name");
+        if (name.size() <= KERNEL_TIME.size() ||
+            name.compare(name.size() - KERNEL_TIME.size(), KERNEL_TIME.size(), KERNEL_TIME) != 0) {
+            continue;
+        }
+        name.resize(name.size() - KERNEL_TIME.size());
+        addLayerTime(profile, name, jsonValue(line, "op_name"), std::atof(jsonValue(line, "dur").c_str()) / 1000.);
+    }
+    return mergeProfiles({&profile});
+}
+
+bool ONNXRuntimeBackend::infer() {
+    try {
+        return run(_requests[0]);
+    } catch (std::exception &ex) {
+        std::cerr << ex.what() << std::endl;
+        return false;
+    }
+}
+
+size_t ONNXRuntimeBackend::getRequestsNum() const {
+    return _requests.size();
+}
+
+bool ONNXRuntimeBackend::startAsync(size_t request) {
+    if (request >= _requests.size()) {
+        return false;
+    }
+    return _requests[request].async->start([this, request](bool status) {
+        if (_callback) {
+            _callback(request, status);
+        }
+    });
+}
+
+bool ONNXRuntimeBackend::wait(size_t request) {
+    if (request >= _requests.size()) {
+        return false;
+    }
+    return _requests[request].async->wait();
+}
+
+void ONNXRuntimeBackend::setCompletionCallback(CompletionCallback callback) {
+    _callback = callback;
+}
+
+std::shared_ptr<VBlob> ONNXRuntimeBackend::getBlob(const std::string &name) {
+    return getBlob(name, 0);
+}
+
+std::shared_ptr<VBlob> ONNXRuntimeBackend::getBlob(const std::string &name, size_t request) {
+    TensorHandle handle = getTensorHandle(name);
+    if (handle == INVALID_TENSOR_HANDLE) {
+        return nullptr;
+    }
+    return _requests.at(request).blobs[handle];
+}
+
+TensorHandle ONNXRuntimeBackend::getTensorHandle(const std::string &name) const {
+    auto it = _handles.find(name);
+    return it != _handles.end() ? it->second : INVALID_TENSOR_HANDLE;
+}
+
+VBlob* ONNXRuntimeBackend::getBlob(TensorHandle handle, size_t request) {
+    return _requests[request].blobs[handle].get();
+}
+
+bool ONNXRuntimeBackend::bindBlob(const std::string &name, std::shared_ptr<VBlob> blob, size_t request) {
+    TensorHandle handle = getTensorHandle(name);
+    if (request >= _requests.size() || handle == INVALID_TENSOR_HANDLE || !blob || !blob->_data) {
+        return false;
+    }
+    // dynamic outputs are allocated by the session, others must match the tensor exactly
+    Request &req = _requests[request];
+    if (_dynamic[handle] || blob->_precision != toPrecision(_types[handle]) ||
+        blob->_shape != req.blobs[handle]->_shape || !blob->_strides.empty()) {
+        return false;
+    }
+    try {
+        Ort::Value value = Ort::Value::CreateTensor(_memoryInfo, blob->_data, blob->byteSize(),
+                                                    _shapes[handle].data(), _shapes[handle].size(), _types[handle]);
+        if (handle < _inputsNum) {
+            req.binding->BindInput(name.c_str(), value);
+        } else {
+            req.binding->BindOutput(name.c_str(), value);
+        }
+        req.values[handle] = std::move(value);
+    } catch (std::exception &) {
+        return false;
+    }
+    req.blobs[handle] = blob;
+    return true;
+}
+
+Backend* ONNXRuntimeBackend::createReplica() {
+    if (!_model) {
+        return nullptr;
+    }
+    ONNXRuntimeBackend* replica = new ONNXRuntimeBackend();
+    replica->_allocator = _allocator;
+    replica->_model = _model;
+    replica->_inputInfo = _inputInfo;
+    replica->_outputInfo = _outputInfo;
+    replica->_handles = _handles;
+    replica->_names = _names;
+    replica->_types = _types;
+    replica->_shapes = _shapes;
+    replica->_dynamic = _dynamic;
+    replica->_inputsNum = _inputsNum;
+    replica->_hasDynamic = _hasDynamic;
+    replica->_bindCores = _bindCores;
+    // session is profiled as a whole, profile is reported by the original backend
+    replica->_profiling = false;
+    if (!replica->createRequests(_requests.size())) {
+        delete replica;
+        return nullptr;
+    }
+    return replica;
+}
+
+void ONNXRuntimeBackend::release() {
+    delete this;
+}
+
+const VInputInfo& ONNXRuntimeBackend::getInputDataMap() const {
+    return _inputInfo;
+}
+
+const VOutputInfo& ONNXRuntimeBackend::getOutputDataMap() const {
+    return _outputInfo;
+}
+
+Backend* createBackend() {
+    return new ONNXRuntimeBackend();
+}
@@ -0,0 +1,93 @@
+// Copyright 2021 the dldt tools authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+
+#include "backend.hpp"
+#include "async_infer_request.hpp"
+
+#include <onnxruntime_cxx_api.h>
+
+extern "C" {
+Backend* createBackend();
+}
+
+/**
+ * Backend on top of ONNX Runtime session. Blobs are bound to the session by IOBinding, so inputs are read
+ * and outputs are written in place. Backend specific config keys:
+ *   INTER_OP_THREADS - threads running independent nodes in parallel, parallel execution mode is used if it is set
+ *   GRAPH_OPTIMIZATION_LEVEL - DISABLE_ALL, BASIC, EXTENDED or ALL (default)
+ */
+class ONNXRuntimeBackend : public Backend {
+public:
+    virtual bool loadModel(const std::string &model, const std::string &device,
+                           const std::vector<std::string> &outputs,
+                           const std::map<std::string, std::string>& config)override;
+    virtual std::shared_ptr<InferenceMetrics> process(bool streamOutput = false)override
+    {
+        return nullptr;
+    }
+    virtual void report(const InferenceMetrics &im) const override;
+    virtual VProfile getProfile() const override;
+    virtual bool infer()override;
+    virtual Backend* createReplica()override;
+    virtual void release()override;
+
+    virtual size_t getRequestsNum() const override;
+    virtual bool startAsync(size_t request)override;
+    virtual bool wait(size_t request)override;
+    virtual void setCompletionCallback(CompletionCallback callback)override;
+
+    virtual std::shared_ptr<VBlob> getBlob(const std::string &name)override;
+    virtual std::shared_ptr<VBlob> getBlob(const std::string &name, size_t request)override;
+    virtual TensorHandle getTensorHandle(const std::string &name) const override;
+    virtual VBlob* getBlob(TensorHandle handle, size_t request)override;
+    virtual bool bindBlob(const std::string &name, std::shared_ptr<VBlob> blob, size_t request)override;
+
+    virtual const VInputInfo& getInputDataMap() const override;
+    virtual const VOutputInfo& getOutputDataMap() const override;
+
+protected:
+    // Session::Run is thread safe, so one session serves all requests and replicas
+    struct Model {
+        // environment must outlive the session
+        Ort::Env env;
+        Ort::Session session;
+        Model(Ort::Env &&env, Ort::Session &&session) : env(std::move(env)), session(std::move(session)) { }
+    };
+
+    struct Request {
+        std::unique_ptr<Ort::IoBinding> binding;
+        // indexed by tensor handle
+        std::vector<std::shared_ptr<VBlob> > blobs;
+        // ORT tensors over memory of blobs, dynamic outputs hold tensors allocated by the session
+        std::vector<Ort::Value> values;
+        std::unique_ptr<AsyncInferRequest> async;
+    };
+
+    bool createRequests(size_t nireq);
+    bool run(Request &request);
+    // reads per-node time from the chrome trace written by ORT profiler
+    static VProfile readProfile(const std::string &fileName);
+
+    VInputInfo _inputInfo;
+    VOutputInfo _outputInfo;
+    std::map<std::string, TensorHandle> _handles;
+    // in the order of handles, inputs first
+    std::vector<std::string> _names;
+    std::vector<ONNXTensorElementDataType> _types;
+    std::vector<std::vector<int64_t> > _shapes;
+    // outputs having dimensions unknown until inference, bound to the session allocator
+    std::vector<bool> _dynamic;
+    size_t _inputsNum = 0;
+    bool _hasDynamic = false;
+
+    CompletionCallback _callback;
+    bool _bindCores = false;
+    bool _profiling = false;
+    std::shared_ptr<Model> _model;
+    // trace is written once profiling is stopped, so profile is read by the first getProfile
+    mutable std::unique_ptr<VProfile> _profile;
+    Ort::MemoryInfo _memoryInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+    // worker threads of requests must be stopped before bindings are destroyed,
+    // async member is declared last in Request for this
+    std::vector<Request> _requests;
+};
@@ -0,0 +1,408 @@
+// Copyright 2021 the dldt tools authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+
+#include "opencv_dnn_backend.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+
+static const char DNN_BACKEND[] = "DNN_BACKEND";
+static const char INPUT_SHAPE[] = "INPUT_SHAPE";
+// cv::dnn::Net has no API to get names of inputs, the only input is fed by empty name and exposed under this one
+static const char INPUT_NAME[] = "input";
+
+static std::string replaceExtension(const std::string &path, const std::string &ext) {
+    size_t dot = path.rfind('.');
+    return (dot == std::string::npos ? path : path.substr(0, dot)) + ext;
+}
+
+static bool endsWith(const std::string &str, const std::string &suffix) {
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool OpenCVDNNBackend::loadModel(const std::string &model, const std::string &device,
+                                 const std::vector<std::string> &outputs,
+                                 const std::map<std::string, std::string> &config) {
+    try {
+        // --------------------------- 1. Find files of the model ----------------------------------------------
+        // readNet recognizes framework by extensions, the second file is weights or text description
+        _model = model;
+        if (endsWith(model, ".xml")) {
+            _weights = replaceExtension(model, ".bin");
+        } else if (endsWith(model, ".prototxt")) {
+            _weights = replaceExtension(model, ".caffemodel");
+        } else if (endsWith(model, ".caffemodel")) {
+            _weights = replaceExtension(model, ".prototxt");
+        }
+
+        // --------------------------- 2. Select backend and target --------------------------------------------
+        std::string dnnBackend = getConfigValue<std::string>(config, DNN_BACKEND, "OPENCV");
+        if (dnnBackend == "OPENCV") {
+            _dnnBackend = cv::dnn::DNN_BACKEND_OPENCV;
+        } else if (dnnBackend == "INFERENCE_ENGINE") {
+            _dnnBackend = cv::dnn::DNN_BACKEND_INFERENCE_ENGINE;
+        } else {
+            std::cerr << "Unknown " << DNN_BACKEND << " " << dnnBackend << ", OPENCV or INFERENCE_ENGINE is expected"
+                      << std::endl;
+            return false;
+        }
+        if (device == "CPU") {
+            _dnnTarget = cv::dnn::DNN_TARGET_CPU;
+        } else if (device == "GPU") {
+            _dnnTarget = cv::dnn::DNN_TARGET_OPENCL;
+        } else if (device == "GPU_FP16") {
+            _dnnTarget = cv::dnn::DNN_TARGET_OPENCL_FP16;
+        } else if (device == "MYRIAD" && _dnnBackend == cv::dnn::DNN_BACKEND_INFERENCE_ENGINE) {
+            _dnnTarget = cv::dnn::DNN_TARGET_MYRIAD;
+        } else {
+            std::cerr << "The device name is not valid. Please select CPU/GPU/GPU_FP16 or MYRIAD with "
+                      << DNN_BACKEND << "=INFERENCE_ENGINE" << std::endl;
+            return false;
+        }
+
+        // --------------------------- 3. Configure execution --------------------------------------------------
+        // OpenCV has one thread pool per process, it is shared by all requests and by the image decoding of the app
+        int threads = getConfigValue<int>(config, BackendConfig::INFERENCE_THREADS, 0);
+        if (threads > 0) {
+            cv::setNumThreads(threads);
+        }
+        std::istringstream shape(getConfigValue<std::string>(config, INPUT_SHAPE, ""));
+        std::string dim;
+        while (std::getline(shape, dim, ',')) {
+            _inputShape.push_back(std::stoul(dim));
+        }
+        _bindCores = getConfigValue<std::string>(config, BackendConfig::CPU_BIND, BackendConfig::NO) == BackendConfig::YES;
+        _profiling = getConfigValue<std::string>(config, BackendConfig::PROFILING, BackendConfig::NO) == BackendConfig::YES;
+        _outputNames = outputs;
+        size_t nireq = std::max<size_t>(1, getConfigValue<size_t>(config, BackendConfig::REQUESTS_NUM, 1));
+        return createRequests(nireq);
+    } catch (std::exception &ex) {
+        std::cerr << ex.what() << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool OpenCVDNNBackend::readNet(cv::dnn::Net &net) const {
+    net = cv::dnn::readNet(_model, _weights);
+    if (net.empty()) {
+        return false;
+    }
+    net.setPreferableBackend(_dnnBackend);
+    net.setPreferableTarget(_dnnTarget);
+    return true;
+}
+
+bool OpenCVDNNBackend::createRequests(size_t nireq) {
+    try {
+        // every request reads own network, weights cannot be shared between cv::dnn::Net objects
+        _requests.resize(nireq);
+        for (auto &request : _requests) {
+            if (!readNet(request.net)) {
+                return false;
+            }
+        }
+        cv::dnn::Net &net = _requests[0].net;
+
+        // --------------------------- 4. Prepare input --------------------------------------------------------
+        if (_inputShape.empty()) {
+            // shape is known only if the model defines it, layer 0 is the input layer of the network
+            try {
+                std::vector<cv::dnn::MatShape> inShapes, outShapes;
+                net.getLayerShapes(cv::dnn::MatShape(), 0, inShapes, outShapes);
+                if (!inShapes.empty()) {
+                    _inputShape.assign(inShapes[0].begin(), inShapes[0].end());
+                }
+            } catch (std::exception &) {
+                // shape inference asserts if the model has no shape of the input
+            }
+        }
+        if (_inputShape.empty() || product(_inputShape) == 0) {
+            std::cerr << "Input shape is not defined by the model, please set " << INPUT_SHAPE << " config key"
+                      << std::endl;
+            return false;
+        }
+        cv::dnn::MatShape inputShape(_inputShape.begin(), _inputShape.end());
+
+        _handles.clear();
+        _handles[INPUT_NAME] = 0;
+        IOInfo info;
+        info._precision = FP32;
+        info._shape = _inputShape;
+        _inputInfo[INPUT_NAME] = info;
+
+        // --------------------------- 5. Prepare output -------------------------------------------------------
+        if (_outputNames.empty()) {
+            _outputNames = net.getUnconnectedOutLayersNames();
+        }
+        for (size_t o = 0; o < _outputNames.size(); o++) {
+            std::vector<cv::dnn::MatShape> inShapes, outShapes;
+            net.getLayerShapes(inputShape, net.getLayerId(_outputNames[o]), inShapes, outShapes);
+            if (outShapes.empty()) {
+                return false;
+            }
+            IOInfo info;
+            info._precision = FP32;
+            info._shape.assign(outShapes[0].begin(), outShapes[0].end());
+            _outputInfo[_outputNames[o]] = info;
+            _handles[_outputNames[o]] = 1 + o;
+        }
+
+        for (auto &request : _requests) {
+            request.blobs.resize(1 + _outputNames.size());
+            request.outputs.resize(_outputNames.size());
+            request.bound.assign(request.blobs.size(), false);
+
+            auto input = std::make_shared<VBlob>();
+            input->_precision = FP32;
+            input->_shape = _inputShape;
+            input->allocate(input->byteSize(), _allocator);
+            request.blobs[0] = input;
+
+            for (size_t o = 0; o < _outputNames.size(); o++) {
+                // replaced by memory of the forward result after every inference
+                auto output = std::make_shared<VBlob>();
+                output->_precision = FP32;
+                output->_shape = _outputInfo[_outputNames[o]]._shape;
+                output->allocate(output->byteSize(), _allocator);
+                request.blobs[1 + o] = output;
+            }
+        }
+
+        for (size_t r = 0; r < nireq; r++) {
+            AsyncInferRequest::Init init = nullptr;
+            if (_bindCores) {
+                // only the worker is pinned, threads of OpenCV pool are shared by all requests
+                init = [r]() { pinCurrentThread(r); };
+            }
+            Request &request = _requests[r];
+            AsyncInferRequest::Task task = [this, &request]() { return forward(request); };
+            if (nativeAsync()) {
+                // inference is started by startAsync, the worker only waits for its result to call the callback
+                task = [this, &request]() { return fetchOutputs(request); };
+            }
+            request.async.reset(new AsyncInferRequest(task, init));
+        }
+    } catch (std::exception &ex) {
+        std::cerr << ex.what() << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool OpenCVDNNBackend::nativeAsync() const {
+#ifdef OPENCV_DNN_FORWARD_ASYNC
+    // forwardAsync returns the only blob, so networks with several outputs are inferred by the worker
+    return _dnnBackend == cv::dnn::DNN_BACKEND_INFERENCE_ENGINE && _outputNames.size() == 1;
+#else
+    return false;
+#endif
+}
+
+void OpenCVDNNBackend::setInput(Request &request) {
+    // setInput copies the data to the network, so the input blob can be filled for the next inference right away
+    VBlob* input = request.blobs[0].get();
+    std::vector<int> dims(input->_shape.begin(), input->_shape.end());
+    request.net.setInput(cv::Mat(dims, CV_32F, input->_data));
+}
+
+bool OpenCVDNNBackend::forward(Request &request) {
+    setInput(request);
+    request.net.forward(request.outputs, _outputNames);
+    if (_profiling) {
+        collectProfile(request);
+    }
+    return fetchOutputs(request);
+}
+
+bool OpenCVDNNBackend::fetchOutputs(Request &request) {
+#ifdef OPENCV_DNN_FORWARD_ASYNC
+    if (request.pending.valid()) {
+        request.pending.get(request.outputs[0]);
+        request.pending.release();
+    }
+#endif
+    for (size_t o = 0; o < request.outputs.size(); o++) {
+        cv::Mat &output = request.outputs[o];
+        VBlob* vblob = request.blobs[1 + o].get();
+        if (output.total() != product(vblob->_shape)) {
+            std::cerr << "Unexpected size of output " << _outputNames[o] << std::endl;
+            return false;
+        }
+        if (output.depth() != CV_32F) {
+            output.convertTo(output, CV_32F);
+        }
+        if (!output.isContinuous()) {
+            output = output.clone();
+        }
+        if (request.bound[1 + o]) {
+            memcpy(vblob->_data, output.data, vblob->byteSize());
+        } else {
+            // result is kept in request.outputs until the next inference of the request
+            vblob->borrow(output.data);
+        }
+    }
+    return true;
+}
+
+void OpenCVDNNBackend::report(const InferenceMetrics &im) const {
+    if (!_profiling) {
+        return;
+    }
+    if (_dnnBackend != cv::dnn::DNN_BACKEND_OPENCV || _dnnTarget != cv::dnn::DNN_TARGET_CPU) {
+        std::cout << "OpenCV collects per-layer profile only for OPENCV backend on CPU" << std::endl;
+        return;
+    }
+    printProfile(std::cout, getProfile());
+}
+
+VProfile OpenCVDNNBackend::getProfile() const {
+    std::vector<const std::map<std::string, LayerProfile>*> profiles;
+    for (auto &request : _requests) {
+        profiles.push_back(&request.profile);
+    }
+    return mergeProfiles(profiles);
+}
+
+void OpenCVDNNBackend::collectProfile(Request &request) {
+    std::vector<double> timings;
+    request.net.getPerfProfile(timings);
+    if (timings.empty()) {
+        return;
+    }
+    // timings are indexed by layer id starting from 1, in the order of getLayerNames
+    std::vector<cv::String> names = request.net.getLayerNames();
+    double msPerTick = 1000. / cv::getTickFrequency();
+    for (size_t i = 0; i < timings.size() && i < names.size(); i++) {
+        // fused layers have zero time, they are accounted in the layer they are fused to
+        if (timings[i] <= 0) {
+            continue;
+        }
+        cv::Ptr<cv::dnn::Layer> layer = request.net.getLayer(static_cast<int>(i + 1));
+        addLayerTime(request.profile, names[i], layer ? layer->type : std::string(), timings[i] * msPerTick);
+    }
+}
+
+bool OpenCVDNNBackend::infer() {
+    try {
+        return forward(_requests[0]);
+    } catch (std::exception &ex) {
+        std::cerr << ex.what() << std::endl;
+        return false;
+    }
+}
+
+size_t OpenCVDNNBackend::getRequestsNum() const {
+    return _requests.size();
+}
+
+bool OpenCVDNNBackend::startAsync(size_t request) {
+    if (request >= _requests.size()) {
+        return false;
+    }
+    Request &req = _requests[request];
+#ifdef OPENCV_DNN_FORWARD_ASYNC
+    if (nativeAsync()) {
+        try {
+            setInput(req);
+            req.pending = req.net.forwardAsync(_outputNames[0]);
+        } catch (std::exception &ex) {
+            std::cerr << ex.what() << std::endl;
+            return false;
+        }
+    }
+#endif
+    return req.async->start([this, request](bool status) {
+        if (_callback) {
+            _callback(request, status);
+        }
+    });
+}
+
+bool OpenCVDNNBackend::wait(size_t request) {
+    if (request >= _requests.size()) {
+        return false;
+    }
+    return _requests[request].async->wait();
+}
+
+void OpenCVDNNBackend::setCompletionCallback(CompletionCallback callback) {
+    _callback = callback;
+}
+
+std::shared_ptr<VBlob> OpenCVDNNBackend::getBlob(const std::string &name) {
+    return getBlob(name, 0);
+}
+
+std::shared_ptr<VBlob> OpenCVDNNBackend::getBlob(const std::string &name, size_t request) {
+    TensorHandle handle = getTensorHandle(name);
+    if (handle == INVALID_TENSOR_HANDLE) {
+        return nullptr;
+    }
+    return _requests.at(request).blobs[handle];
+}
+
+TensorHandle OpenCVDNNBackend::getTensorHandle(const std::string &name) const {
+    auto it = _handles.find(name);
+    return it != _handles.end() ? it->second : INVALID_TENSOR_HANDLE;
+}
+
+VBlob* OpenCVDNNBackend::getBlob(TensorHandle handle, size_t request) {
+    return _requests[request].blobs[handle].get();
+}
+
+bool OpenCVDNNBackend::bindBlob(const std::string &name, std::shared_ptr<VBlob> blob, size_t request) {
+    TensorHandle handle = getTensorHandle(name);
+    if (request >= _requests.size() || handle == INVALID_TENSOR_HANDLE || !blob || !blob->_data) {
+        return false;
+    }
+    // network always copies input in setInput and result to bound output, only dense float memory is accepted
+    Request &req = _requests[request];
+    VBlob* current = req.blobs[handle].get();
+    if (blob->_precision != FP32 || blob->_shape != current->_shape || !blob->_strides.empty()) {
+        return false;
+    }
+    req.blobs[handle] = blob;
+    req.bound[handle] = true;
+    return true;
+}
+
+Backend* OpenCVDNNBackend::createReplica() {
+    if (_requests.empty()) {
+        return nullptr;
+    }
+    OpenCVDNNBackend* replica = new OpenCVDNNBackend();
+    replica->_allocator = _allocator;
+    replica->_model = _model;
+    replica->_weights = _weights;
+    replica->_dnnBackend = _dnnBackend;
+    replica->_dnnTarget = _dnnTarget;
+    replica->_inputShape = _inputShape;
+    replica->_outputNames = _outputNames;
+    replica->_bindCores = _bindCores;
+    replica->_profiling = _profiling;
+    if (!replica->createRequests(_requests.size())) {
+        delete replica;
+        return nullptr;
+    }
+    return replica;
+}
+
+void OpenCVDNNBackend::release() {
+    delete this;
+}
+
+const VInputInfo& OpenCVDNNBackend::getInputDataMap() const {
+    return _inputInfo;
+}
+
+const VOutputInfo& OpenCVDNNBackend::getOutputDataMap() const {
+    return _outputInfo;
+}
+
+Backend* createBackend() {
+    return new OpenCVDNNBackend();
+}
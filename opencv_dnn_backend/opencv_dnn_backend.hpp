@@ -0,0 +1,96 @@
+// Copyright 2021 the dldt tools authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+
+#include "backend.hpp"
+#include "async_infer_request.hpp"
+
+#include <opencv2/core.hpp>
+#include <opencv2/dnn.hpp>
+
+// Net::forwardAsync appeared in OpenCV 4.2 and works only with DNN_BACKEND_INFERENCE_ENGINE
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 2)
+#define OPENCV_DNN_FORWARD_ASYNC
+#endif
+
+extern "C" {
+Backend* createBackend();
+}
+
+/**
+ * Backend on top of cv::dnn::Net, reads every format supported by cv::dnn::readNet (ONNX, TensorFlow, Caffe, IR).
+ * Needs nothing but OpenCV, so it is the reference point for the vendor backends.
+ * Backend specific config keys:
+ *   DNN_BACKEND - OPENCV (default) or INFERENCE_ENGINE, the latter enables native asynchronous execution
+ *   INPUT_SHAPE - comma separated shape of the input, used if the model does not define it, e.g. 1,3,224,224
+ */
+class OpenCVDNNBackend : public Backend {
+public:
+    virtual bool loadModel(const std::string &model, const std::string &device,
+                           const std::vector<std::string> &outputs,
+                           const std::map<std::string, std::string>& config)override;
+    virtual std::shared_ptr<InferenceMetrics> process(bool streamOutput = false)override
+    {
+        return nullptr;
+    }
+    virtual void report(const InferenceMetrics &im) const override;
+    virtual VProfile getProfile() const override;
+    virtual bool infer()override;
+    virtual Backend* createReplica()override;
+    virtual void release()override;
+
+    virtual size_t getRequestsNum() const override;
+    virtual bool startAsync(size_t request)override;
+    virtual bool wait(size_t request)override;
+    virtual void setCompletionCallback(CompletionCallback callback)override;
+
+    virtual std::shared_ptr<VBlob> getBlob(const std::string &name)override;
+    virtual std::shared_ptr<VBlob> getBlob(const std::string &name, size_t request)override;
+    virtual TensorHandle getTensorHandle(const std::string &name) const override;
+    virtual VBlob* getBlob(TensorHandle handle, size_t request)override;
+    virtual bool bindBlob(const std::string &name, std::shared_ptr<VBlob> blob, size_t request)override;
+
+    virtual const VInputInfo& getInputDataMap() const override;
+    virtual const VOutputInfo& getOutputDataMap() const override;
+
+protected:
+    struct Request {
+        // cv::dnn::Net is not thread safe, every request has own network
+        cv::dnn::Net net;
+        // indexed by tensor handle, the only input goes first
+        std::vector<std::shared_ptr<VBlob> > blobs;
+        // results of forward, output blobs borrow their memory unless bound to the memory of the caller
+        std::vector<cv::Mat> outputs;
+        std::vector<bool> bound;
+#ifdef OPENCV_DNN_FORWARD_ASYNC
+        cv::AsyncArray pending;
+#endif
+        std::map<std::string, LayerProfile> profile;
+        std::unique_ptr<AsyncInferRequest> async;
+    };
+
+    bool createRequests(size_t nireq);
+    bool readNet(cv::dnn::Net &net) const;
+    void setInput(Request &request);
+    bool forward(Request &request);
+    bool fetchOutputs(Request &request);
+    void collectProfile(Request &request);
+    bool nativeAsync() const;
+
+    VInputInfo _inputInfo;
+    VOutputInfo _outputInfo;
+    std::map<std::string, TensorHandle> _handles;
+    // names of output layers in the order of handles
+    std::vector<std::string> _outputNames;
+
+    CompletionCallback _callback;
+    std::string _model;
+    std::string _weights;
+    int _dnnBackend = cv::dnn::DNN_BACKEND_OPENCV;
+    int _dnnTarget = cv::dnn::DNN_TARGET_CPU;
+    VShape _inputShape;
+    bool _bindCores = false;
+    bool _profiling = false;
+    // worker threads of requests must be stopped before networks are destroyed,
+    // async member is declared last in Request for this
+    std::vector<Request> _requests;
+};
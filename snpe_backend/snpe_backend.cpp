@@ -4,13 +4,22 @@
 #include "snpe_backend.hpp"
 
 #include <string.h>
-#include <DlContainer/IDlContainer.hpp>
+#include <algorithm>
 #include "DlSystem/RuntimeList.hpp"
 #include "SNPE/SNPEBuilder.hpp"
 #include "DlSystem/UDLFunc.hpp"
-#include <DlSystem/ITensorFactory.hpp>
+#include "DlSystem/IBufferAttributes.hpp"
+#include "DlSystem/IUserBufferFactory.hpp"
 #include <SNPE/SNPEFactory.hpp>
 
+// diagnostic logs of requests are written to subfolders of this one in profiling mode
+static const char DIAGLOG_DIR[] = "snpe_diaglog";
+// backend specific config keys
+static const char INPUT_ENCODING[] = "INPUT_ENCODING";
+static const char OUTPUT_ENCODING[] = "OUTPUT_ENCODING";
+static const char ENCODING_FLOAT[] = "FLOAT";
+static const char ENCODING_TF8[] = "TF8";
+
 bool SNPEBackend::loadModel(const std::string &model, const std::string &device,
                             const std::vector<std::string> &outputs,
                             const std::map<std::string, std::string> &config) {
@@ -18,144 +27,395 @@ bool SNPEBackend::loadModel(const std::string &model, const std::string &device,
     try {
 
         // --------------------------- 1. Read IR Generated by SNPE tools (.dl file) ------------
-        std::unique_ptr<zdl::DlContainer::IDlContainer> container;
-        container = zdl::DlContainer::IDlContainer::open(zdl::DlSystem::String(model.c_str()));
-        if (container == nullptr) {
+        _container = zdl::DlContainer::IDlContainer::open(zdl::DlSystem::String(model.c_str()));
+        if (_container == nullptr) {
             std::cerr << "Error while opening the container file." << std::endl;
-            return EXIT_FAILURE;
+            return false;
         }
 
         // --------------------------- 2. Loading model to the device ------------------------------------------
-        zdl::DlSystem::Runtime_t runtime = zdl::DlSystem::Runtime_t::CPU;
-        if (device == "GPU") {
-            runtime = zdl::DlSystem::Runtime_t::GPU_FLOAT16;
-        } else if (device == "DSP") {
-            runtime = zdl::DlSystem::Runtime_t::DSP_FIXED8_TF;
-        } else if (device == "CPU") {
-            runtime = zdl::DlSystem::Runtime_t::CPU_FLOAT32;
-        } else {
-            std::cerr << "The device is not valid. Set default CPU runtime." << std::endl;
-            runtime = zdl::DlSystem::Runtime_t::CPU_FLOAT32;
+        _device = device;
+        _outputs = outputs;
+        // SNPE has neither configurable number of threads nor streams, profile is mapped to the closest one
+        std::string profile = getConfigValue<std::string>(config, BackendConfig::PERFORMANCE_PROFILE, "");
+        if (profile == BackendConfig::PROFILE_LATENCY) {
+            _profile = zdl::DlSystem::PerformanceProfile_t::BURST;
+        } else if (profile == BackendConfig::PROFILE_THROUGHPUT) {
+            _profile = zdl::DlSystem::PerformanceProfile_t::SUSTAINED_HIGH_PERFORMANCE;
+        } else if (profile == BackendConfig::PROFILE_BALANCED) {
+            _profile = zdl::DlSystem::PerformanceProfile_t::BALANCED;
+        } else if (profile == BackendConfig::PROFILE_POWER_SAVER) {
+            _profile = zdl::DlSystem::PerformanceProfile_t::POWER_SAVER;
         }
-
-        zdl::DlSystem::RuntimeList runtimeList;
-        runtimeList.add(runtime);
-        // add CPU fallback
-        if (runtime != zdl::DlSystem::Runtime_t::CPU_FLOAT32) {
-            runtimeList.add(zdl::DlSystem::Runtime_t::CPU_FLOAT32);
+        _bindCores = getConfigValue<std::string>(config, BackendConfig::CPU_BIND, BackendConfig::NO) == BackendConfig::YES;
+        _profiling = getConfigValue<std::string>(config, BackendConfig::PROFILING, BackendConfig::NO) == BackendConfig::YES;
+        _batch = std::max(0, getConfigValue<int>(config, BackendConfig::BATCH, 0));
+        for (auto key : {INPUT_ENCODING, OUTPUT_ENCODING}) {
+            std::string encoding = getConfigValue<std::string>(config, key, ENCODING_FLOAT);
+            if (encoding != ENCODING_FLOAT && encoding != ENCODING_TF8) {
+                std::cerr << "Unknown " << key << " " << encoding << ", " << ENCODING_FLOAT << " or "
+                          << ENCODING_TF8 << " is expected" << std::endl;
+                return false;
+            }
         }
+        _tf8Inputs = getConfigValue<std::string>(config, INPUT_ENCODING, ENCODING_FLOAT) == ENCODING_TF8;
+        _tf8Outputs = getConfigValue<std::string>(config, OUTPUT_ENCODING, ENCODING_FLOAT) == ENCODING_TF8;
+        size_t nireq = std::max<size_t>(1, getConfigValue<size_t>(config, BackendConfig::REQUESTS_NUM, 1));
+        return createRequests(nireq);
+    } catch (std::exception &ex) {
+        return false;
+    }
 
-        zdl::SNPE::SNPEBuilder snpeBuilder(container.get());
+    return true;
+}
 
-        zdl::DlSystem::StringList snpeOutputs;
-        for (auto o : outputs) {
-            snpeOutputs.append(o.c_str());
-        }
-        _snpe = snpeBuilder.setOutputLayers(snpeOutputs)
-            .setRuntimeProcessorOrder(runtimeList)
-            .setDebugMode(false)
-            // BALANCED HIGH_PERFORMANCE POWER_SAVER SYSTEM_SETTINGS SUSTAINED_HIGH_PERFORMANCE BURST
-            // LOW_POWER_SAVER HIGH_POWER_SAVER LOW_BALANCED
-            .setPerformanceProfile(zdl::DlSystem::PerformanceProfile_t::HIGH_PERFORMANCE)
-            .setProfilingLevel(zdl::DlSystem::ProfilingLevel_t::OFF)
-            .build();
-        if (!_snpe) {
-            return false;
+bool SNPEBackend::createRequests(size_t nireq) {
+    try {
+        // every request has own SNPE object built from the same container
+        _requests.resize(nireq);
+        for (auto &request : _requests) {
+            request.snpe = buildSNPE(_device, _outputs);
+            if (!request.snpe) {
+                return false;
+            }
+            // dimensions of the model are known from the built object only, it is rebuilt once if batch differs
+            if (!_inputsResized && resizeInputs(*request.snpe)) {
+                request.snpe = buildSNPE(_device, _outputs);
+                if (!request.snpe) {
+                    return false;
+                }
+            }
+            if (_profiling) {
+                startDiagLog(request, &request - &_requests[0]);
+            }
         }
 
-        zdl::DlSystem::StringList inputNames = _snpe->getInputTensorNames();
+        zdl::SNPE::SNPE *snpe = _requests[0].snpe.get();
+        zdl::DlSystem::StringList inputNames = snpe->getInputTensorNames();
+        zdl::DlSystem::StringList outputNames = snpe->getOutputTensorNames();
+        // handles are indices of inputs followed by indices of outputs
+        std::vector<std::string> names;
         for (size_t i = 0; i < inputNames.size(); i++) {
-            std::string name = inputNames.at(i);
-            auto bufferAttributesOpt = _snpe->getInputOutputBufferAttributes(name.c_str());
-            if (!bufferAttributesOpt) throw std::runtime_error(std::string("Error obtaining attributes for input tensor ") + name);
-            // calculate the size of buffer required by the input tensor
+            names.push_back(inputNames.at(i));
+        }
+        for (size_t o = 0; o < outputNames.size(); o++) {
+            names.push_back(outputNames.at(o));
+        }
+        _handles.clear();
+        _outputNames.clear();
+        _encodings.clear();
+        for (auto &request : _requests) {
+            request.blobs.resize(names.size());
+            request.buffers.resize(names.size());
+        }
+        for (size_t h = 0; h < names.size(); h++) {
+            const std::string &name = names[h];
+            const bool input = h < inputNames.size();
+            _handles[name] = h;
+            if (!input) {
+                _outputNames.push_back(name);
+            }
+            auto bufferAttributesOpt = snpe->getInputOutputBufferAttributes(name.c_str());
+            if (!bufferAttributesOpt) throw std::runtime_error(std::string("Error obtaining attributes for tensor ") + name);
             const zdl::DlSystem::TensorShape bufferShape = (*bufferAttributesOpt)->getDims();
+            Encoding encoding = getEncoding(*snpe, name, input);
+            _encodings.push_back(encoding);
 
             IOInfo info;
-            info._precision = FP32;
+            info._precision = encoding.step > 0.f ? U8 : FP32;
             info._shape.resize(bufferShape.rank());
             for (size_t j = 0; j < bufferShape.rank(); j++) {
                 info._shape[j] = bufferShape.getDimensions()[j];
             }
-            _inputInfo[name] = info;
-
-            std::shared_ptr<zdl::DlSystem::ITensor> inputTensor =
-                zdl::SNPE::SNPEFactory::getTensorFactory().createTensor(bufferShape);
-            _inputTensorMap.add(name.c_str(), inputTensor.get());
-            tensors.push_back(inputTensor);
-
-            auto vblob = std::make_shared<VBlob>();
-            vblob->_precision = FP32;
-            vblob->_shape = info._shape;
-            vblob->_data = reinterpret_cast<void *>(&(*inputTensor->begin()));
-            vblob->_ownMemory = false;
-            vblob->_layout = "NHWC";
-            vblob->_colourFormat = "RGB";
-            _blobs[name] = vblob;
-        }
+            if (input) {
+                _inputInfo[name] = info;
+            } else {
+                _outputInfo[name] = info;
+            }
 
-        zdl::DlSystem::StringList outputNames = _snpe->getOutputTensorNames();
-        for (size_t o = 0; o < outputNames.size(); o++) {
-            std::string name = outputNames.at(o);
-            auto bufferAttributesOpt = _snpe->getInputOutputBufferAttributes(name.c_str());
-            if (!bufferAttributesOpt) throw std::runtime_error(std::string("Error obtaining attributes for output tensor ") + name);
-            // calculate the size of buffer required by the input tensor
-            const zdl::DlSystem::TensorShape &bufferShape = (*bufferAttributesOpt)->getDims();
+            // strides of user buffers are in bytes, tensors are dense
+            const size_t elementSize = encoding.step > 0.f ? sizeof(uint8_t) : sizeof(float);
+            std::vector<size_t> strides(bufferShape.rank());
+            size_t stride = elementSize;
+            for (size_t j = strides.size(); j-- > 0;) {
+                strides[j] = stride;
+                stride *= info._shape[j];
+            }
+            zdl::DlSystem::UserBufferEncodingFloat floatEncoding;
+            zdl::DlSystem::UserBufferEncodingTf8 tf8Encoding(encoding.stepExactly0, encoding.step);
+            zdl::DlSystem::UserBufferEncoding *bufferEncoding = &floatEncoding;
+            if (encoding.step > 0.f) {
+                bufferEncoding = &tf8Encoding;
+            }
 
-            IOInfo info;
-            info._precision = FP32;
-            info._shape.resize(bufferShape.rank());
-            for (size_t j = 0; j < bufferShape.rank(); j++) {
-                info._shape[j] = bufferShape.getDimensions()[j];
+            for (auto &request : _requests) {
+                auto vblob = std::make_shared<VBlob>();
+                vblob->_precision = info._precision;
+                vblob->_shape = info._shape;
+                vblob->allocate(product(vblob->_shape) * elementSize, _allocator);
+                if (input) {
+                    vblob->_layout = NHWC;
+                    vblob->_colourFormat = RGB;
+                } else if (encoding.step > 0.f) {
+                    vblob->_scale = encoding.step;
+                    vblob->_zeroPoint = encoding.stepExactly0;
+                }
+                // SNPE reads and writes memory of the blob, nothing is copied on execution
+                std::unique_ptr<zdl::DlSystem::IUserBuffer> buffer =
+                    zdl::SNPE::SNPEFactory::getUserBufferFactory().createUserBuffer(
+                        vblob->_data, vblob->byteSize(),
+                        zdl::DlSystem::TensorShape(strides.data(), strides.size()), bufferEncoding);
+                if (!buffer) throw std::runtime_error(std::string("Error creating user buffer for tensor ") + name);
+                if (input) {
+                    request.inputMap.add(name.c_str(), buffer.get());
+                } else {
+                    request.outputMap.add(name.c_str(), buffer.get());
+                }
+                request.buffers[h] = std::move(buffer);
+                request.blobs[h] = vblob;
             }
-            _outputInfo[name] = info;
+        }
 
-            auto vblob = std::make_shared<VBlob>();
-            vblob->_precision = FP32;
-            vblob->_shape = info._shape;
-            vblob->_data = (unsigned char *)malloc(product(vblob->_shape) * sizeof(float));
-            _blobs[name] = vblob;
+        for (size_t r = 0; r < nireq; r++) {
+            AsyncInferRequest::Init init = nullptr;
+            if (_bindCores) {
+                init = [r]() { pinCurrentThread(r); };
+            }
+            _requests[r].async.reset(new AsyncInferRequest([this, r]() { return execute(_requests[r]); }, init));
         }
     } catch (std::exception &ex) {
+        std::cerr << ex.what() << std::endl;
         return false;
     }
 
     return true;
 }
 
+bool SNPEBackend::resizeInputs(const zdl::SNPE::SNPE &snpe) {
+    _inputsResized = true;
+    if (_batch == 0) {
+        return false;
+    }
+    zdl::DlSystem::StringList inputNames = snpe.getInputTensorNames();
+    for (size_t i = 0; i < inputNames.size(); i++) {
+        auto bufferAttributesOpt = snpe.getInputOutputBufferAttributes(inputNames.at(i));
+        if (!bufferAttributesOpt) {
+            continue;
+        }
+        const zdl::DlSystem::TensorShape shape = (*bufferAttributesOpt)->getDims();
+        // batch of image inputs only, as other backends do
+        if (shape.rank() == 4 && shape.getDimensions()[0] != _batch) {
+            std::vector<size_t> dims(shape.getDimensions(), shape.getDimensions() + shape.rank());
+            dims[0] = _batch;
+            _inputDimensions[inputNames.at(i)] = dims;
+        }
+    }
+    return !_inputDimensions.empty();
+}
+
+SNPEBackend::Encoding SNPEBackend::getEncoding(const zdl::SNPE::SNPE &snpe, const std::string &name, bool input) const {
+    Encoding encoding;
+    auto bufferAttributesOpt = snpe.getInputOutputBufferAttributes(name.c_str());
+    if (!bufferAttributesOpt) {
+        return encoding;
+    }
+    const zdl::DlSystem::IBufferAttributes *attributes = *bufferAttributesOpt;
+    if (input) {
+        // U8 pixels p stand for (p - 128) / 127, the value of the float input filled by the app
+        if (_tf8Inputs && attributes->getDims().rank() == 4) {
+            encoding.stepExactly0 = 128;
+            encoding.step = 1.f / 127.f;
+        }
+    } else if (_tf8Outputs && attributes->getEncodingType() == zdl::DlSystem::UserBufferEncoding::ElementType_t::TF8) {
+        // the runtime writes quantized outputs as they are with its own step and offset
+        auto tf8 = dynamic_cast<const zdl::DlSystem::UserBufferEncodingTf8*>(attributes->getEncoding());
+        if (tf8 && tf8->getQuantizedStepSize() > 0.f) {
+            encoding.stepExactly0 = tf8->getStepExactly0();
+            encoding.step = tf8->getQuantizedStepSize();
+        }
+    }
+    return encoding;
+}
+
+std::unique_ptr<zdl::SNPE::SNPE> SNPEBackend::buildSNPE(const std::string &device, const std::vector<std::string> &outputs) {
+    zdl::DlSystem::Runtime_t runtime = zdl::DlSystem::Runtime_t::CPU;
+    if (device == "GPU") {
+        runtime = zdl::DlSystem::Runtime_t::GPU_FLOAT16;
+    } else if (device == "DSP") {
+        runtime = zdl::DlSystem::Runtime_t::DSP_FIXED8_TF;
+    } else if (device == "CPU") {
+        runtime = zdl::DlSystem::Runtime_t::CPU_FLOAT32;
+    } else {
+        std::cerr << "The device is not valid. Set default CPU runtime." << std::endl;
+        runtime = zdl::DlSystem::Runtime_t::CPU_FLOAT32;
+    }
+
+    zdl::DlSystem::RuntimeList runtimeList;
+    runtimeList.add(runtime);
+    // add CPU fallback
+    if (runtime != zdl::DlSystem::Runtime_t::CPU_FLOAT32) {
+        runtimeList.add(zdl::DlSystem::Runtime_t::CPU_FLOAT32);
+    }
+
+    zdl::SNPE::SNPEBuilder snpeBuilder(_container.get());
+
+    zdl::DlSystem::StringList snpeOutputs;
+    for (auto o : outputs) {
+        snpeOutputs.append(o.c_str());
+    }
+    zdl::DlSystem::TensorShapeMap inputDimensions;
+    for (auto &input : _inputDimensions) {
+        inputDimensions.add(input.first.c_str(), zdl::DlSystem::TensorShape(input.second.data(), input.second.size()));
+    }
+    return snpeBuilder.setOutputLayers(snpeOutputs)
+        .setInputDimensions(inputDimensions)
+        .setUseUserSuppliedBuffers(true)
+        .setRuntimeProcessorOrder(runtimeList)
+        .setDebugMode(false)
+        // BALANCED HIGH_PERFORMANCE POWER_SAVER SYSTEM_SETTINGS SUSTAINED_HIGH_PERFORMANCE BURST
+        // LOW_POWER_SAVER HIGH_POWER_SAVER LOW_BALANCED
+        .setPerformanceProfile(_profile)
+        .setProfilingLevel(_profiling ? zdl::DlSystem::ProfilingLevel_t::DETAILED : zdl::DlSystem::ProfilingLevel_t::OFF)
+        .build();
+}
+
+void SNPEBackend::startDiagLog(Request &request, size_t index) {
+    auto diagLog = request.snpe->getDiagLogInterface();
+    if (!diagLog) {
+        std::cerr << "SNPE diagnostic log is not available, profiling is disabled" << std::endl;
+        return;
+    }
+    zdl::DiagLog::IDiagLog* logger = *diagLog;
+    zdl::DiagLog::Options options = logger->getOptions();
+    options.LogFileDirectory = std::string(DIAGLOG_DIR) + "/request_" + std::to_string(index);
+    if (!logger->setOptions(options) || !logger->start()) {
+        std::cerr << "Cannot start SNPE diagnostic log in " << options.LogFileDirectory << std::endl;
+    }
+}
+
 void SNPEBackend::report(const InferenceMetrics &im) const {
+    if (_profiling) {
+        // SNPE writes per-layer times to the binary diagnostic log only, there is no API to read them back
+        std::cout << "SNPE per-layer profile is written to " << DIAGLOG_DIR << "/request_<N>,"
+                  << " use snpe-diagview to print it" << std::endl;
+    }
+}
 
+VProfile SNPEBackend::getProfile() const {
+    return VProfile();
 }
+
+bool SNPEBackend::execute(Request &request) {
+    // user buffers point to blobs, outputs are in blobs once execution is finished
+    return request.snpe->execute(request.inputMap, request.outputMap);
+}
+
 bool SNPEBackend::infer() {
-    bool execStatus = _snpe->execute(_inputTensorMap, _outputTensorMap);
-    if (execStatus) {
-        zdl::DlSystem::StringList outNames = _outputTensorMap.getTensorNames();
-        for (size_t i = 0; i < outNames.size(); i++) {
-            auto vblob = _blobs[outNames.at(i)];
-            zdl::DlSystem::ITensor *outTensor = _outputTensorMap.getTensor(outNames.at(i));
-            if (vblob && outTensor) {
-                const void *oData = reinterpret_cast<void *>(&(*outTensor->begin()));
-                memcpy(vblob->_data, oData, product(vblob->_shape) * sizeof(float));
-            }
+    return execute(_requests[0]);
+}
+
+size_t SNPEBackend::getRequestsNum() const {
+    return _requests.size();
+}
+
+bool SNPEBackend::startAsync(size_t request) {
+    if (request >= _requests.size()) {
+        return false;
+    }
+    return _requests[request].async->start([this, request](bool status) {
+        if (_callback) {
+            _callback(request, status);
         }
+    });
+}
+
+bool SNPEBackend::wait(size_t request) {
+    if (request >= _requests.size()) {
+        return false;
     }
-    return execStatus;
+    return _requests[request].async->wait();
+}
+
+void SNPEBackend::setCompletionCallback(CompletionCallback callback) {
+    _callback = callback;
 }
 
 std::shared_ptr<VBlob> SNPEBackend::getBlob(const std::string &name) {
-    return _blobs[name];
+    return getBlob(name, 0);
+}
+
+std::shared_ptr<VBlob> SNPEBackend::getBlob(const std::string &name, size_t request) {
+    TensorHandle handle = getTensorHandle(name);
+    if (handle == INVALID_TENSOR_HANDLE) {
+        return nullptr;
+    }
+    return _requests.at(request).blobs[handle];
+}
+
+TensorHandle SNPEBackend::getTensorHandle(const std::string &name) const {
+    auto it = _handles.find(name);
+    return it != _handles.end() ? it->second : INVALID_TENSOR_HANDLE;
 }
 
+VBlob* SNPEBackend::getBlob(TensorHandle handle, size_t request) {
+    return _requests[request].blobs[handle].get();
+}
+
+bool SNPEBackend::bindBlob(const std::string &name, std::shared_ptr<VBlob> blob, size_t request) {
+    TensorHandle handle = getTensorHandle(name);
+    if (request >= _requests.size() || handle == INVALID_TENSOR_HANDLE || !blob || !blob->_data) {
+        return false;
+    }
+    // encoding and strides of user buffer are set on creation, only address of the memory can be changed
+    Request &req = _requests[request];
+    const VBlob &current = *req.blobs[handle];
+    if (blob->_precision != current._precision || blob->_shape != current._shape || !blob->_strides.empty()) {
+        return false;
+    }
+    if (!req.buffers[handle]->setBufferAddress(blob->_data)) {
+        return false;
+    }
+    blob->_scale = current._scale;
+    blob->_zeroPoint = current._zeroPoint;
+    req.blobs[handle] = blob;
+    return true;
+}
+
+Backend* SNPEBackend::createReplica() {
+    if (!_container) {
+        return nullptr;
+    }
+    // SNPE has no API to share weights between SNPE objects, the replica shares the opened
+    // container only and every SNPE object loads weights to its runtime on build
+    SNPEBackend* replica = new SNPEBackend();
+    replica->_allocator = _allocator;
+    replica->_container = _container;
+    replica->_device = _device;
+    replica->_outputs = _outputs;
+    replica->_profile = _profile;
+    replica->_bindCores = _bindCores;
+    replica->_profiling = _profiling;
+    replica->_tf8Inputs = _tf8Inputs;
+    replica->_tf8Outputs = _tf8Outputs;
+    replica->_batch = _batch;
+    replica->_inputDimensions = _inputDimensions;
+    replica->_inputsResized = _inputsResized;
+    if (!replica->createRequests(_requests.size())) {
+        delete replica;
+        return nullptr;
+    }
+    return replica;
+}
 
 void SNPEBackend::release() {
     delete this;
 }
 
-VInputInfo SNPEBackend::getInputDataMap() const {
+const VInputInfo& SNPEBackend::getInputDataMap() const {
     return _inputInfo;
 }
 
-VOutputInfo SNPEBackend::getOutputDataMap() const {
+const VOutputInfo& SNPEBackend::getOutputDataMap() const {
     return _outputInfo;
 }
 
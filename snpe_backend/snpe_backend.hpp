@@ -2,15 +2,27 @@
 // Use of this source code is governed by a BSD-style license
 
 #include "backend.hpp"
+#include "async_infer_request.hpp"
 
 #include "SNPE/SNPE.hpp"
-#include <DlSystem/ITensorFactory.hpp>
-#include "DlSystem/TensorMap.hpp"
+#include <DlContainer/IDlContainer.hpp>
+#include "DlSystem/IUserBuffer.hpp"
+#include "DlSystem/UserBufferMap.hpp"
+#include "DiagLog/IDiagLog.hpp"
 
 extern "C" {
 Backend* createBackend();
 }
 
+/**
+ * Backend on top of SNPE objects built from the same container, one per request. Inputs and outputs are user
+ * buffers over memory of blobs, so SNPE reads and writes blobs in place. BATCH resizes the leading dimension of
+ * 4D inputs by setInputDimensions. Backend specific config keys:
+ *   INPUT_ENCODING  - FLOAT (default) or TF8. TF8 image inputs are U8 pixels, SNPE dequantizes them to the same
+ *                     values the app gives in float, (pixel - 128) / 127
+ *   OUTPUT_ENCODING - FLOAT (default) or TF8. TF8 is applied to outputs quantized by the runtime (DSP, AIP), they
+ *                     are given to the app as U8 with step and offset of the runtime
+ */
 class SNPEBackend : public Backend {
 public:
     virtual bool loadModel(const std::string &model, const std::string &device,
@@ -21,24 +33,74 @@ public:
         return nullptr;
     }
     virtual void report(const InferenceMetrics &im) const override;
+    virtual VProfile getProfile() const override;
     virtual bool infer()override;
+    virtual Backend* createReplica()override;
     virtual void release()override;
 
+    virtual size_t getRequestsNum() const override;
+    virtual bool startAsync(size_t request)override;
+    virtual bool wait(size_t request)override;
+    virtual void setCompletionCallback(CompletionCallback callback)override;
+
     virtual std::shared_ptr<VBlob> getBlob(const std::string &name)override;
+    virtual std::shared_ptr<VBlob> getBlob(const std::string &name, size_t request)override;
+    virtual TensorHandle getTensorHandle(const std::string &name) const override;
+    virtual VBlob* getBlob(TensorHandle handle, size_t request)override;
+    virtual bool bindBlob(const std::string &name, std::shared_ptr<VBlob> blob, size_t request)override;
 
-    virtual VInputInfo getInputDataMap() const override;
-    virtual VOutputInfo getOutputDataMap() const override;
+    virtual const VInputInfo& getInputDataMap() const override;
+    virtual const VOutputInfo& getOutputDataMap() const override;
 
 protected:
-    std::map<std::string, std::shared_ptr<VBlob> > _blobs;
+    struct Request {
+        std::unique_ptr<zdl::SNPE::SNPE> snpe;
+        // this container will retain and release user buffers since UserBufferMap operate with raw pointers,
+        // indexed by tensor handle
+        std::vector<std::unique_ptr<zdl::DlSystem::IUserBuffer>> buffers;
+
+        zdl::DlSystem::UserBufferMap inputMap;
+        zdl::DlSystem::UserBufferMap outputMap;
+        // indexed by tensor handle
+        std::vector<std::shared_ptr<VBlob> > blobs;
+        std::unique_ptr<AsyncInferRequest> async;
+    };
+
+    // TF8 encoding of a tensor, real value is (q - stepExactly0) * step. 0 step for float tensors
+    struct Encoding {
+        float step = 0.f;
+        unsigned char stepExactly0 = 0;
+    };
+
+    bool createRequests(size_t nireq);
+    std::unique_ptr<zdl::SNPE::SNPE> buildSNPE(const std::string &device, const std::vector<std::string> &outputs);
+    // fills _inputDimensions for BATCH, returns true if the SNPE object must be rebuilt with them
+    bool resizeInputs(const zdl::SNPE::SNPE &snpe);
+    Encoding getEncoding(const zdl::SNPE::SNPE &snpe, const std::string &name, bool input) const;
+    bool execute(Request &request);
+    void startDiagLog(Request &request, size_t index);
 
     VInputInfo _inputInfo;
     VOutputInfo _outputInfo;
+    std::map<std::string, TensorHandle> _handles;
+    // output names in the order of handles
+    std::vector<std::string> _outputNames;
+    // indexed by tensor handle
+    std::vector<Encoding> _encodings;
 
-    // this container will retain and release snpe tensors since TensorMap operate with raw pointers
-    std::unique_ptr<zdl::SNPE::SNPE> _snpe;
-    std::vector<std::shared_ptr<zdl::DlSystem::ITensor>> tensors;
-
-    zdl::DlSystem::TensorMap _inputTensorMap;
-    zdl::DlSystem::TensorMap _outputTensorMap;
+    CompletionCallback _callback;
+    std::string _device;
+    std::vector<std::string> _outputs;
+    zdl::DlSystem::PerformanceProfile_t _profile = zdl::DlSystem::PerformanceProfile_t::HIGH_PERFORMANCE;
+    bool _bindCores = false;
+    bool _profiling = false;
+    bool _tf8Inputs = false;
+    bool _tf8Outputs = false;
+    size_t _batch = 0;
+    // dimensions of inputs resized for BATCH, copied to replicas so they are built resized at once
+    std::map<std::string, std::vector<size_t> > _inputDimensions;
+    bool _inputsResized = false;
+    // shared with replicas
+    std::shared_ptr<zdl::DlContainer::IDlContainer> _container;
+    std::vector<Request> _requests;
 };
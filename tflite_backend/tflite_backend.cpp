@@ -7,6 +7,58 @@
 #endif
 
 #include <string.h>
+#include <algorithm>
+#include <sstream>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "tensorflow/lite/schema/schema_generated.h"
+
+static const char XNNPACK[] = "XNNPACK";
+static const char XNNPACK_THREADS[] = "XNNPACK_THREADS";
+static const char DEQUANTIZE[] = "DEQUANTIZE";
+
+/**
+ * (q - zeroPoint) * scale for bytes, int8 values are passed with flip = 0x80 which maps them to uint8 range,
+ * zero point must be shifted the same way. 16 values are converted per iteration
+ */
+static void dequantizeBytes(const uint8_t* src, float* dst, size_t size, float scale, int32_t zeroPoint, uint8_t flip) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i flipv = _mm_set1_epi8(static_cast<char>(flip));
+    const __m128i zeroPointv = _mm_set1_epi16(static_cast<int16_t>(zeroPoint));
+    const __m128 scalev = _mm_set1_ps(scale);
+    for (; i + 16 <= size; i += 16) {
+        __m128i q = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), flipv);
+        // differences fit int16, they are sign extended to int32 by shift of duplicated halves
+        __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(q, zero), zeroPointv);
+        __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(q, zero), zeroPointv);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16)), scalev));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16)), scalev));
+        _mm_storeu_ps(dst + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16)), scalev));
+        _mm_storeu_ps(dst + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16)), scalev));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const uint8x16_t flipv = vdupq_n_u8(flip);
+    const int16x8_t zeroPointv = vdupq_n_s16(static_cast<int16_t>(zeroPoint));
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t q = veorq_u8(vld1q_u8(src + i), flipv);
+        int16x8_t lo = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(q))), zeroPointv);
+        int16x8_t hi = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(q))), zeroPointv);
+        vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(lo))), scale));
+        vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(lo))), scale));
+        vst1q_f32(dst + i + 8, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(hi))), scale));
+        vst1q_f32(dst + i + 12, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(hi))), scale));
+    }
+#endif
+    for (; i < size; i++) {
+        dst[i] = (static_cast<int32_t>(src[i] ^ flip) - zeroPoint) * scale;
+    }
+}
 
 bool TFLiteBackend::loadModel(const std::string &model, const std::string &device,
                             const std::vector<std::string> &outputs,
@@ -22,79 +74,89 @@ bool TFLiteBackend::loadModel(const std::string &model, const std::string &devic
         }
 
         // --------------------------- 2. Loading model to the device ------------------------------------------
-        tflite::ops::builtin::BuiltinOpResolver resolver;
-
-        tflite::InterpreterBuilder(*_model, resolver)(&_interpreter);
-        if (!_interpreter) {
-          // std::cerr << "Failed to construct interpreter." << std::endl;
-          return false;
+        _device = device;
+        // TFLite has no streams and profiles, requests play role of streams
+        _threads = getConfigValue<int>(config, BackendConfig::INFERENCE_THREADS, 0);
+        if (_threads <= 0) {
+            _threads = 1;
+        }
+        _batch = std::max(0, getConfigValue<int>(config, BackendConfig::BATCH, 0));
+        _xnnpack = getConfigValue<std::string>(config, XNNPACK, BackendConfig::YES) == BackendConfig::YES;
+        _dequantize = getConfigValue<std::string>(config, DEQUANTIZE, BackendConfig::YES) == BackendConfig::YES;
+        _xnnpackThreads = getConfigValue<int>(config, XNNPACK_THREADS, _threads);
+        if (_xnnpackThreads <= 0) {
+            _xnnpackThreads = _threads;
         }
+        _bindCores = getConfigValue<std::string>(config, BackendConfig::CPU_BIND, BackendConfig::NO) == BackendConfig::YES;
+        _profiling = getConfigValue<std::string>(config, BackendConfig::PROFILING, BackendConfig::NO) == BackendConfig::YES;
+#if defined(TFLITE_XNNPACK_WEIGHTS_CACHE)
+        if (_xnnpack && _device == "CPU") {
+            // XNNPACK packs weights once, delegates of all requests and replicas take them from the cache
+            _weightsCache = std::shared_ptr<TfLiteXNNPackDelegateWeightsCache>(
+                TfLiteXNNPackDelegateWeightsCacheCreate(), TfLiteXNNPackDelegateWeightsCacheDelete);
+        }
+#endif
+        size_t nireq = std::max<size_t>(1, getConfigValue<size_t>(config, BackendConfig::REQUESTS_NUM, 1));
+        return createRequests(nireq);
+    } catch (std::exception &ex) {
+        return false;
+    }
 
-        _interpreter->SetNumThreads(1);
+    return true;
+}
 
-        // there is offloading part
-        TfLiteDelegate* delegate = nullptr;
-        if (device == "GPU") {
-/*        #if defined(__ANDROID__)
-          TfLiteGpuDelegateOptionsV2 gpu_opts = TfLiteGpuDelegateOptionsV2Default();
-          gpu_opts.inference_preference =
-              TFLITE_GPU_INFERENCE_PREFERENCE_SUSTAINED_SPEED;
-          gpu_opts.inference_priority1 =
-              s->allow_fp16 ? TFLITE_GPU_INFERENCE_PRIORITY_MIN_LATENCY
-                            : TFLITE_GPU_INFERENCE_PRIORITY_MAX_PRECISION;
-          auto delegate = evaluation::CreateGPUDelegate(&gpu_opts);
-        #else
-          auto delegate = evaluation::CreateGPUDelegate();
-        #endif
-
-          if (!delegate) {
-            std::cerr << "GPU acceleration is unsupported on this platform.";
-            return -1;
-          } else {
-            delegates.emplace("GPU", std::move(delegate));
-          }
-*/
-        } else if (device == "DSP") {
-#if defined(__ANDROID__) && (defined(__arm__) || defined(__aarch64__))
-          TfLiteHexagonInit();
-          TfLiteHexagonDelegateOptions options({0});
-          delegate = TfLiteHexagonDelegateCreate(&options);
-          if (!delegate) {
-            std::cerr << "Hexagon acceleration is unsupported on this platform.";
-            TfLiteHexagonTearDown();
-            return -1;
-          } /*else {
-            delegates.emplace("Hexagon", std::move(delegate));
-          }*/
-#endif
-        } else if (device == "CPU") {
-            // default execution unit, no additional actions are required
-        } else {
-           std::cerr << "The device name is not valid. Please select CPU/DSP/GPU." << std::endl;
-           return -1;
+bool TFLiteBackend::createRequests(size_t nireq) {
+    try {
+        // every request has own interpreter, all of them share the same flatbuffer model
+        _requests.resize(nireq);
+        for (size_t r = 0; r < nireq; r++) {
+            if (_bindCores) {
+                // every request gets its own group of cores. Thread pools of the interpreter and XNNPACK are
+                // created with the interpreter and inherit cores of the thread creating it
+                std::thread thread([this, r]() {
+                    pinCurrentThread(r * _threads, _threads);
+                    try {
+                        _requests[r].interpreter = createInterpreter(_requests[r]);
+                    } catch (std::exception &) {
+                        _requests[r].interpreter.reset();
+                    }
+                });
+                thread.join();
+            } else {
+                _requests[r].interpreter = createInterpreter(_requests[r]);
+            }
+            if (!_requests[r].interpreter) {
+                return false;
+            }
+            if (_profiling) {
+                // two events per node are enough, delegate kernels produce one event per delegated subgraph
+                tflite::Interpreter* interpreter = _requests[r].interpreter.get();
+                _requests[r].profiler.reset(new tflite::profiling::BufferedProfiler(
+                    static_cast<uint32_t>(2 * interpreter->execution_plan().size() + 16)));
+                interpreter->SetProfiler(_requests[r].profiler.get());
+            }
         }
-
-        if (delegate) {
-          if (_interpreter->ModifyGraphWithDelegate(delegate) !=
-              kTfLiteOk) {
-            std::cerr << "Failed to apply TFLite delegate." << std::endl;
-            return -1;
-          }
-          std::cout << "Applied deligation successfully" << std::endl;
+#if defined(TFLITE_XNNPACK_WEIGHTS_CACHE)
+        // cache must be finalized before inference, soft finalization lets delegates of replicas use it too
+        if (_weightsCache) {
+            TfLiteXNNPackDelegateWeightsCacheFinalizeSoft(_weightsCache.get());
         }
+#endif
 
         // --------------------------- 3. Prepare input --------------------------------------------------------
-        if (_interpreter->AllocateTensors() != kTfLiteOk) {
-          std::cerr << "Failed to allocate tensors!" << std::endl;
-          return EXIT_FAILURE;
+        tflite::Interpreter* interpreter = _requests[0].interpreter.get();
+        const std::vector<int> inputs = interpreter->inputs();
+        const std::vector<int> outputs = interpreter->outputs();
+        _handles.clear();
+        for (auto &request : _requests) {
+            request.blobs.resize(inputs.size() + outputs.size());
         }
-
-        const std::vector<int> inputs = _interpreter->inputs();
         for (size_t i = 0; i < inputs.size(); i++) {
-            std::string name = _interpreter->GetInputName(i);
+            std::string name = interpreter->GetInputName(i);
+            _handles[name] = i;
 
             IOInfo info;
-            switch (_interpreter->tensor(inputs[i])->type) {
+            switch (interpreter->tensor(inputs[i])->type) {
             case kTfLiteFloat32:
                 info._precision = FP32;
                 break;
@@ -105,64 +167,90 @@ bool TFLiteBackend::loadModel(const std::string &model, const std::string &devic
                 return false;
             }
 
-            TfLiteIntArray* tfdims = _interpreter->tensor(inputs[i])->dims;
+            TfLiteIntArray* tfdims = interpreter->tensor(inputs[i])->dims;
             info._shape.resize(tfdims->size);
             for (size_t j = 0; j < tfdims->size; j++) {
                 info._shape[j] = tfdims->data[j];
             }
             _inputInfo[name] = info;
 
-            auto vblob = std::make_shared<VBlob>();
-            vblob->_precision = info._precision;
-            vblob->_shape = info._shape;
-            switch (_interpreter->tensor(inputs[i])->type) {
-            case kTfLiteFloat32:
-                vblob->_data = reinterpret_cast<void *>(_interpreter->typed_tensor<float>(inputs[i]));
-                break;
-            case kTfLiteUInt8:
-                vblob->_data = reinterpret_cast<void *>(_interpreter->typed_tensor<uint8_t>(inputs[i]));
-                break;
-            default:
-                return false;
+            for (auto &request : _requests) {
+                auto vblob = std::make_shared<VBlob>();
+                vblob->_precision = info._precision;
+                vblob->_shape = info._shape;
+                // input is filled directly in the tensor of interpreter
+                vblob->borrow(request.interpreter->tensor(inputs[i])->data.raw);
+                vblob->_layout = NHWC;
+                vblob->_colourFormat = RGB;
+                request.blobs[i] = vblob;
             }
-            vblob->_ownMemory = false;
-            vblob->_layout = "NHWC";
-            vblob->_colourFormat = "RGB";
-            _blobs[name] = vblob;
         }
 
-
-        const std::vector<int> outputs = _interpreter->outputs();
+        _quantization.assign(outputs.size(), Quantization());
         for (size_t o = 0; o < outputs.size(); o++) {
-            std::string name = _interpreter->GetOutputName(o);
+            std::string name = interpreter->GetOutputName(o);
+            _handles[name] = inputs.size() + o;
 
             IOInfo info;
-            switch (_interpreter->tensor(outputs[o])->type) {
+            const TfLiteTensor* tensor = interpreter->tensor(outputs[o]);
+            switch (tensor->type) {
             case kTfLiteFloat32:
                 info._precision = FP32;
                 break;
             case kTfLiteUInt8:
                 info._precision = U8;
                 break;
+            case kTfLiteInt8:
+                info._precision = I8;
+                break;
             default:
                 return false;
             }
+            Quantization quantization;
+            if (info._precision != FP32) {
+                quantization = getQuantization(tensor);
+            }
+            // order of values quantized per tensor is the order of real values, the app can use them as is
+            bool native = info._precision == FP32 || (!_dequantize && quantization.scales.size() == 1);
+            if (!native) {
+                _quantization[o] = quantization;
+            }
 
-            TfLiteIntArray* tfdims = _interpreter->tensor(outputs[o])->dims;
+            TfLiteIntArray* tfdims = interpreter->tensor(outputs[o])->dims;
             info._shape.resize(tfdims->size);
             for (size_t j = 0; j < tfdims->size; j++) {
                 info._shape[j] = tfdims->data[j];
             }
             _outputInfo[name] = info;
 
-            auto vblob = std::make_shared<VBlob>();
-            // By fact, there might be (U)int8 output from TFLite model
-            // at the same time it is rediculos and eventually we must operate by float output
-            // we will convert fron uint8 to float after inference
-            vblob->_precision = FP32;
-            vblob->_shape = info._shape;
-            vblob->_data = (unsigned char *)malloc(product(vblob->_shape) * sizeof(float));
-            _blobs[name] = vblob;
+            for (auto &request : _requests) {
+                auto vblob = std::make_shared<VBlob>();
+                vblob->_shape = info._shape;
+                if (native) {
+                    vblob->_precision = info._precision;
+                    if (info._precision != FP32) {
+                        vblob->_scale = quantization.scales[0];
+                        vblob->_zeroPoint = quantization.zeroPoints[0];
+                    }
+                    vblob->borrow(request.interpreter->tensor(outputs[o])->data.raw);
+                } else {
+                    // quantized output is converted to float after inference
+                    vblob->_precision = FP32;
+                    vblob->allocate(product(vblob->_shape) * sizeof(float), _allocator);
+                }
+                request.blobs[inputs.size() + o] = vblob;
+            }
+        }
+
+        for (size_t r = 0; r < nireq; r++) {
+            AsyncInferRequest::Init init = nullptr;
+            if (_bindCores) {
+                // the worker runs on the cores of the request, so do threads it creates on the first inference
+                size_t core = r * _threads;
+                size_t cores = _threads;
+                init = [core, cores]() { pinCurrentThread(core, cores); };
+            }
+            _requests[r].async.reset(new AsyncInferRequest([this, r]() { return invoke(_requests[r]); }, init));
         }
     } catch (std::exception &ex) {
         return false;
@@ -171,38 +259,248 @@ bool TFLiteBackend::loadModel(const std::string &model, const std::string &devic
     return true;
 }
 
+TFLiteBackend::Quantization TFLiteBackend::getQuantization(const TfLiteTensor* tensor) {
+    Quantization quantization;
+    const TfLiteAffineQuantization* affine = nullptr;
+    if (tensor->quantization.type == kTfLiteAffineQuantization) {
+        affine = static_cast<const TfLiteAffineQuantization*>(tensor->quantization.params);
+    }
+    if (affine && affine->scale && affine->scale->size > 1) {
+        for (int c = 0; c < affine->scale->size; c++) {
+            quantization.scales.push_back(affine->scale->data[c]);
+            quantization.zeroPoints.push_back(affine->zero_point && affine->zero_point->size > c ? affine->zero_point->data[c] : 0);
+        }
+        for (int d = 0; d < tensor->dims->size; d++) {
+            if (d < affine->quantized_dimension) {
+                quantization.outer *= tensor->dims->data[d];
+            } else if (d > affine->quantized_dimension) {
+                quantization.inner *= tensor->dims->data[d];
+            }
+        }
+    } else {
+        // legacy parameters are filled for per tensor quantization too
+        quantization.scales.push_back(tensor->params.scale);
+        quantization.zeroPoints.push_back(tensor->params.zero_point);
+        quantization.inner = tensor->bytes;
+    }
+    return quantization;
+}
+
+void TFLiteBackend::dequantize(const TfLiteTensor* tensor, const Quantization &quantization, float* dst) {
+    const uint8_t* src = tensor->data.uint8;
+    // int8 is read as uint8, both value and zero point are shifted by 128
+    uint8_t flip = tensor->type == kTfLiteInt8 ? 0x80 : 0;
+    int32_t shift = tensor->type == kTfLiteInt8 ? 128 : 0;
+    size_t channels = quantization.scales.size();
+    for (size_t i = 0; i < quantization.outer; i++) {
+        for (size_t c = 0; c < channels; c++) {
+            dequantizeBytes(src, dst, quantization.inner, quantization.scales[c], quantization.zeroPoints[c] + shift, flip);
+            src += quantization.inner;
+            dst += quantization.inner;
+        }
+    }
+}
+
+std::map<std::string, size_t> TFLiteBackend::countBuiltinOps(const tflite::Interpreter* interpreter) {
+    std::map<std::string, size_t> ops;
+    for (int node : interpreter->execution_plan()) {
+        const auto *nodeAndReg = interpreter->node_and_registration(node);
+        if (!nodeAndReg || nodeAndReg->first.delegate) {
+            continue;
+        }
+        const TfLiteRegistration &reg = nodeAndReg->second;
+        if (reg.builtin_code == tflite::BuiltinOperator_CUSTOM && reg.custom_name) {
+            ops[reg.custom_name]++;
+        } else {
+            ops[tflite::EnumNameBuiltinOperator(static_cast<tflite::BuiltinOperator>(reg.builtin_code))]++;
+        }
+    }
+    return ops;
+}
+
+std::unique_ptr<tflite::Interpreter> TFLiteBackend::createInterpreter(Request &request) {
+    // delegates are applied explicitly, the resolver must not apply XNNPACK the library might be built with
+    tflite::ops::builtin::BuiltinOpResolverWithoutDefaultDelegates resolver;
+    std::unique_ptr<tflite::Interpreter> interpreter;
+
+    tflite::InterpreterBuilder(*_model, resolver)(&interpreter);
+    if (!interpreter) {
+      // std::cerr << "Failed to construct interpreter." << std::endl;
+      return nullptr;
+    }
+
+    interpreter->SetNumThreads(_threads);
+
+    // batched inference amortizes interpreter overhead, the leading dimension of image inputs is the batch.
+    // Shapes of other tensors are propagated by AllocateTensors, input is resized before delegates take the graph
+    if (_batch > 0) {
+        for (int input : interpreter->inputs()) {
+            const TfLiteIntArray* dims = interpreter->tensor(input)->dims;
+            if (dims->size == 4 && dims->data[0] != _batch) {
+                std::vector<int> shape(dims->data, dims->data + dims->size);
+                shape[0] = _batch;
+                if (interpreter->ResizeInputTensor(input, shape) != kTfLiteOk) {
+                    std::cerr << "Cannot resize input " << interpreter->tensor(input)->name << " to batch " << _batch << std::endl;
+                    return nullptr;
+                }
+            }
+        }
+    }
+
+    // there is offloading part
+    TfLiteDelegate* delegate = nullptr;
+    if (_device == "GPU") {
+/*        #if defined(__ANDROID__)
+      TfLiteGpuDelegateOptionsV2 gpu_opts = TfLiteGpuDelegateOptionsV2Default();
+      gpu_opts.inference_preference =
+          TFLITE_GPU_INFERENCE_PREFERENCE_SUSTAINED_SPEED;
+      gpu_opts.inference_priority1 =
+          s->allow_fp16 ? TFLITE_GPU_INFERENCE_PRIORITY_MIN_LATENCY
+                        : TFLITE_GPU_INFERENCE_PRIORITY_MAX_PRECISION;
+      auto delegate = evaluation::CreateGPUDelegate(&gpu_opts);
+    #else
+      auto delegate = evaluation::CreateGPUDelegate();
+    #endif
+
+      if (!delegate) {
+        std::cerr << "GPU acceleration is unsupported on this platform.";
+        return -1;
+      } else {
+        delegates.emplace("GPU", std::move(delegate));
+      }
+*/
+    } else if (_device == "DSP") {
+#if defined(__ANDROID__) && (defined(__arm__) || defined(__aarch64__))
+      TfLiteHexagonInit();
+      TfLiteHexagonDelegateOptions options({0});
+      delegate = TfLiteHexagonDelegateCreate(&options);
+      if (!delegate) {
+        std::cerr << "Hexagon acceleration is unsupported on this platform.";
+        TfLiteHexagonTearDown();
+        return nullptr;
+      } /*else {
+        delegates.emplace("Hexagon", std::move(delegate));
+      }*/
+#endif
+    } else if (_device == "CPU") {
+#if defined(TFLITE_XNNPACK)
+        if (_xnnpack) {
+            // delegate has own thread pool, interpreter threads run only operators left on builtin kernels
+            TfLiteXNNPackDelegateOptions options = TfLiteXNNPackDelegateOptionsDefault();
+            options.num_threads = _xnnpackThreads;
+#if defined(TFLITE_XNNPACK_WEIGHTS_CACHE)
+            options.weights_cache = _weightsCache.get();
+#endif
+            request.delegate = std::unique_ptr<TfLiteDelegate, void(*)(TfLiteDelegate*)>(
+                TfLiteXNNPackDelegateCreate(&options), TfLiteXNNPackDelegateDelete);
+            delegate = request.delegate.get();
+            if (!delegate) {
+                std::cerr << "Cannot create XNNPACK delegate, builtin kernels are used" << std::endl;
+            }
+        }
+#endif
+    } else {
+       std::cerr << "The device name is not valid. Please select CPU/DSP/GPU." << std::endl;
+       return nullptr;
+    }
+
+    if (delegate) {
+      std::map<std::string, size_t> allOps = countBuiltinOps(interpreter.get());
+      if (interpreter->ModifyGraphWithDelegate(delegate) !=
+          kTfLiteOk) {
+        std::cerr << "Failed to apply TFLite delegate." << std::endl;
+        return nullptr;
+      }
+      // all interpreters have the same graph, delegation is described once
+      if (_delegation.empty()) {
+          size_t total = 0;
+          size_t builtin = 0;
+          std::ostringstream left;
+          std::map<std::string, size_t> builtinOps = countBuiltinOps(interpreter.get());
+          for (auto &op : allOps) {
+              total += op.second;
+          }
+          for (auto &op : builtinOps) {
+              builtin += op.second;
+              left << " " << op.first << " x" << op.second;
+          }
+          _delegation = std::to_string(total - builtin) + " of " + std::to_string(total) +
+                        " operators are delegated to " + (_device == "CPU" ? "XNNPACK" : _device);
+          if (builtin > 0) {
+              _delegation += ", left on builtin kernels:" + left.str();
+          }
+      }
+    }
+
+    if (interpreter->AllocateTensors() != kTfLiteOk) {
+      std::cerr << "Failed to allocate tensors!" << std::endl;
+      if (_batch > 0) {
+          std::cerr << "Operators of the model might not support batch " << _batch << std::endl;
+      }
+      return nullptr;
+    }
+
+    return interpreter;
+}
+
 void TFLiteBackend::report(const InferenceMetrics &im) const {
+    if (!_delegation.empty()) {
+        std::cout << "Delegation: " << _delegation << std::endl;
+    }
+    if (_profiling) {
+        printProfile(std::cout, getProfile());
+    }
+}
 
+VProfile TFLiteBackend::getProfile() const {
+    std::vector<const std::map<std::string, LayerProfile>*> profiles;
+    for (auto &request : _requests) {
+        profiles.push_back(&request.profile);
+    }
+    return mergeProfiles(profiles);
 }
-bool TFLiteBackend::infer() {
 
-    if (_interpreter->Invoke() == kTfLiteOk) {
-        const std::vector<int> outputs = _interpreter->outputs();
+void TFLiteBackend::collectProfile(Request &request) {
+    tflite::Interpreter* interpreter = request.interpreter.get();
+    for (auto event : request.profiler->GetProfileEvents()) {
+        if (event->event_type != tflite::profiling::ProfileEvent::EventType::OPERATOR_INVOKE_EVENT &&
+            event->event_type != tflite::profiling::ProfileEvent::EventType::DELEGATE_OPERATOR_INVOKE_EVENT) {
+            continue;
+        }
+        // operators are named by their first output tensor, event tag is type of operator
+        int node = static_cast<int>(event->event_metadata);
+        std::string name = "node_" + std::to_string(node);
+        const auto *nodeAndReg = interpreter->node_and_registration(node);
+        if (nodeAndReg && nodeAndReg->first.outputs && nodeAndReg->first.outputs->size > 0) {
+            const TfLiteTensor* output = interpreter->tensor(nodeAndReg->first.outputs->data[0]);
+            if (output && output->name) {
+                name = output->name;
+            }
+        }
+        addLayerTime(request.profile, name, event->tag,
+                     (event->end_timestamp_us - event->begin_timestamp_us) / 1000.);
+    }
+}
+
+bool TFLiteBackend::invoke(Request &request) {
+    tflite::Interpreter* interpreter = request.interpreter.get();
+    if (request.profiler) {
+        request.profiler->Reset();
+        request.profiler->StartProfiling();
+    }
+    TfLiteStatus status = interpreter->Invoke();
+    if (request.profiler) {
+        request.profiler->StopProfiling();
+        collectProfile(request);
+    }
+    if (status == kTfLiteOk) {
+        const std::vector<int> &outputs = interpreter->outputs();
+        const size_t firstOutput = interpreter->inputs().size();
         for (size_t o = 0; o < outputs.size(); o++) {
-            int output = _interpreter->outputs()[o];
-            std::string name = _interpreter->GetOutputName(o);
-            auto vblob = _blobs[name];
-            switch (_interpreter->tensor(output)->type) {
-            case kTfLiteFloat32:
-                {
-                    float* oData = _interpreter->typed_output_tensor<float>(o);
-                    memcpy(vblob->_data, oData, product(vblob->_shape) * sizeof(float));
-                }
-                break;
-            case kTfLiteUInt8:
-                {
-                    uint8_t* oData = _interpreter->typed_output_tensor<uint8_t>(o);
-                    float* fblobData = static_cast<float*>(vblob->_data);
-                    for (size_t j = 0; j < product(vblob->_shape); j++) {
-                        float value = oData[j] + (static_cast<float>(j) / 10000.f);
-                        fblobData[j] = value / 256.f;
-                    }
-                }
-                break;
-            default:
-                std::cerr << "cannot handle network output type " <<
-                _interpreter->tensor(output)->type << std::endl;
-                return EXIT_FAILURE;
+            // float and natively exposed outputs are borrowed by blobs, nothing to convert
+            if (!_quantization[o].scales.empty()) {
+                dequantize(interpreter->tensor(outputs[o]), _quantization[o],
+                           static_cast<float*>(request.blobs[firstOutput + o]->_data));
             }
         }
         return true;
@@ -210,20 +508,135 @@ bool TFLiteBackend::infer() {
     return false;
 }
 
+bool TFLiteBackend::infer() {
+    return invoke(_requests[0]);
+}
+
+size_t TFLiteBackend::getRequestsNum() const {
+    return _requests.size();
+}
+
+bool TFLiteBackend::startAsync(size_t request) {
+    if (request >= _requests.size()) {
+        return false;
+    }
+    return _requests[request].async->start([this, request](bool status) {
+        if (_callback) {
+            _callback(request, status);
+        }
+    });
+}
+
+bool TFLiteBackend::wait(size_t request) {
+    if (request >= _requests.size()) {
+        return false;
+    }
+    return _requests[request].async->wait();
+}
+
+void TFLiteBackend::setCompletionCallback(CompletionCallback callback) {
+    _callback = callback;
+}
+
 std::shared_ptr<VBlob> TFLiteBackend::getBlob(const std::string &name) {
-    return _blobs[name];
+    return getBlob(name, 0);
+}
+
+std::shared_ptr<VBlob> TFLiteBackend::getBlob(const std::string &name, size_t request) {
+    TensorHandle handle = getTensorHandle(name);
+    if (handle == INVALID_TENSOR_HANDLE) {
+        return nullptr;
+    }
+    return _requests.at(request).blobs[handle];
+}
+
+TensorHandle TFLiteBackend::getTensorHandle(const std::string &name) const {
+    auto it = _handles.find(name);
+    return it != _handles.end() ? it->second : INVALID_TENSOR_HANDLE;
+}
+
+VBlob* TFLiteBackend::getBlob(TensorHandle handle, size_t request) {
+    return _requests[request].blobs[handle].get();
 }
 
+int TFLiteBackend::tensorIndex(const tflite::Interpreter* interpreter, TensorHandle handle) {
+    size_t ninputs = interpreter->inputs().size();
+    return handle < ninputs ? interpreter->inputs()[handle] : interpreter->outputs()[handle - ninputs];
+}
+
+bool TFLiteBackend::bindBlob(const std::string &name, std::shared_ptr<VBlob> blob, size_t request) {
+    TensorHandle handle = getTensorHandle(name);
+    if (request >= _requests.size() || handle == INVALID_TENSOR_HANDLE || !blob || !blob->_data) {
+        return false;
+    }
+    Request &req = _requests[request];
+    tflite::Interpreter* interpreter = req.interpreter.get();
+    int index = tensorIndex(interpreter, handle);
+
+    // interpreter can use external memory only if it has exactly the type of the tensor and arena alignment,
+    // dequantized outputs cannot be bound
+    const TfLiteTensor* tensor = interpreter->tensor(index);
+    evPrecision precision = tensor->type == kTfLiteFloat32 ? FP32 :
+                            tensor->type == kTfLiteUInt8 ? U8 : (tensor->type == kTfLiteInt8 ? I8 : UNSPECIFIED);
+    size_t ninputs = interpreter->inputs().size();
+    if ((handle >= ninputs && !_quantization[handle - ninputs].scales.empty()) || blob->_precision != precision || blob->byteSize() != tensor->bytes ||
+        reinterpret_cast<uintptr_t>(blob->_data) % kTensorAlignment != 0) {
+        return false;
+    }
+
+    TfLiteCustomAllocation allocation = {blob->_data, tensor->bytes};
+    if (interpreter->SetCustomAllocationForTensor(index, allocation) != kTfLiteOk ||
+        interpreter->AllocateTensors() != kTfLiteOk) {
+        return false;
+    }
+    req.blobs[handle] = blob;
+
+    // arena might be reallocated, blobs borrowing tensors of the interpreter must follow
+    for (size_t h = 0; h < req.blobs.size(); h++) {
+        auto &vblob = req.blobs[h];
+        if (!vblob->ownsMemory() && vblob != blob) {
+            vblob->borrow(interpreter->tensor(tensorIndex(interpreter, h))->data.raw);
+        }
+    }
+    return true;
+}
+
+Backend* TFLiteBackend::createReplica() {
+    if (!_model) {
+        return nullptr;
+    }
+    // constant tensors of interpreters point to the flatbuffer, so sharing the model shares weights
+    TFLiteBackend* replica = new TFLiteBackend();
+    replica->_allocator = _allocator;
+    replica->_model = _model;
+#if defined(TFLITE_XNNPACK_WEIGHTS_CACHE)
+    replica->_weightsCache = _weightsCache;
+#endif
+    replica->_device = _device;
+    replica->_threads = _threads;
+    replica->_batch = _batch;
+    replica->_xnnpack = _xnnpack;
+    replica->_dequantize = _dequantize;
+    replica->_xnnpackThreads = _xnnpackThreads;
+    replica->_delegation = _delegation;
+    replica->_bindCores = _bindCores;
+    replica->_profiling = _profiling;
+    if (!replica->createRequests(_requests.size())) {
+        delete replica;
+        return nullptr;
+    }
+    return replica;
+}
 
 void TFLiteBackend::release() {
     delete this;
 }
 
-VInputInfo TFLiteBackend::getInputDataMap() const {
+const VInputInfo& TFLiteBackend::getInputDataMap() const {
     return _inputInfo;
 }
 
-VOutputInfo TFLiteBackend::getOutputDataMap() const {
+const VOutputInfo& TFLiteBackend::getOutputDataMap() const {
     return _outputInfo;
 }
 
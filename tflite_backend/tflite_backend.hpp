@@ -2,16 +2,31 @@
 // Use of this source code is governed by a BSD-style license
 
 #include "backend.hpp"
+#include "async_infer_request.hpp"
 
 #include "tensorflow/lite/model_builder.h"
 #include "tensorflow/lite/interpreter.h"
 #include "tensorflow/lite/interpreter_builder.h"
 #include "tensorflow/lite/kernels/register.h"
+#include "tensorflow/lite/profiling/buffered_profiler.h"
+#if defined(TFLITE_XNNPACK)
+#include "tensorflow/lite/delegates/xnnpack/xnnpack_delegate.h"
+#endif
 
 extern "C" {
 Backend* createBackend();
 }
 
+/**
+ * Backend on top of TFLite interpreter, every request has own interpreter. Backend specific config keys:
+ *   XNNPACK         - YES (default) applies XNNPACK delegate on CPU, NO keeps builtin kernels
+ *   XNNPACK_THREADS - size of XNNPACK thread pool, INFERENCE_THREADS by default
+ * Delegates of all requests and replicas share one cache of packed weights, so the model weights are repacked
+ * once. The cache needs TFLite 2.9 or later, older versions are built with -DTFLITE_XNNPACK_WEIGHTS_CACHE=OFF and
+ * keep packed weights per request
+ *   DEQUANTIZE      - YES (default) converts quantized outputs to float, NO exposes outputs quantized per tensor
+ *                     as U8/I8 blobs having scale and zero point
+ */
 class TFLiteBackend : public Backend {
 public:
     virtual bool loadModel(const std::string &model, const std::string &device,
@@ -22,21 +37,86 @@ public:
         return nullptr;
     }
     virtual void report(const InferenceMetrics &im) const override;
+    virtual VProfile getProfile() const override;
     virtual bool infer()override;
+    virtual Backend* createReplica()override;
     virtual void release()override;
 
+    virtual size_t getRequestsNum() const override;
+    virtual bool startAsync(size_t request)override;
+    virtual bool wait(size_t request)override;
+    virtual void setCompletionCallback(CompletionCallback callback)override;
+
     virtual std::shared_ptr<VBlob> getBlob(const std::string &name)override;
+    virtual std::shared_ptr<VBlob> getBlob(const std::string &name, size_t request)override;
+    virtual TensorHandle getTensorHandle(const std::string &name) const override;
+    virtual VBlob* getBlob(TensorHandle handle, size_t request)override;
+    virtual bool bindBlob(const std::string &name, std::shared_ptr<VBlob> blob, size_t request)override;
 
-    virtual VInputInfo getInputDataMap() const override;
-    virtual VOutputInfo getOutputDataMap() const override;
+    virtual const VInputInfo& getInputDataMap() const override;
+    virtual const VOutputInfo& getOutputDataMap() const override;
 
 protected:
-    std::map<std::string, std::shared_ptr<VBlob> > _blobs;
+    // alignment of interpreter arena, required by custom tensor allocations
+    static const size_t kTensorAlignment = 64;
+
+    // affine quantization of output, per-axis parameters are applied to runs of inner elements
+    struct Quantization {
+        std::vector<float> scales;
+        std::vector<int32_t> zeroPoints;
+        // elements before and after the quantized axis
+        size_t outer = 1;
+        size_t inner = 1;
+    };
+
+    struct Request {
+        // interpreter keeps raw pointers to profiler and delegate, so they are destroyed after it
+        std::unique_ptr<tflite::profiling::BufferedProfiler> profiler;
+        std::unique_ptr<TfLiteDelegate, void(*)(TfLiteDelegate*)> delegate{nullptr, [](TfLiteDelegate*) {}};
+        std::unique_ptr<tflite::Interpreter> interpreter;
+        // indexed by tensor handle
+        std::vector<std::shared_ptr<VBlob> > blobs;
+        std::map<std::string, LayerProfile> profile;
+        std::unique_ptr<AsyncInferRequest> async;
+    };
+
+    bool createRequests(size_t nireq);
+    std::unique_ptr<tflite::Interpreter> createInterpreter(Request &request);
+    // number of operators of each type executed by builtin kernels, delegate kernels are not counted
+    static std::map<std::string, size_t> countBuiltinOps(const tflite::Interpreter* interpreter);
+    bool invoke(Request &request);
+    void collectProfile(Request &request);
+    // handles are indices of interpreter inputs followed by indices of outputs
+    static int tensorIndex(const tflite::Interpreter* interpreter, TensorHandle handle);
+    static Quantization getQuantization(const TfLiteTensor* tensor);
+    // (q - zeroPoint) * scale of every element of the tensor into float blob
+    static void dequantize(const TfLiteTensor* tensor, const Quantization &quantization, float* dst);
 
     VInputInfo _inputInfo;
     VOutputInfo _outputInfo;
+    std::map<std::string, TensorHandle> _handles;
 
-    // this container will retain and release snpe tensors since TensorMap operate with raw pointers
-    std::unique_ptr<tflite::FlatBufferModel> _model;
-    std::unique_ptr<tflite::Interpreter> _interpreter;
+    CompletionCallback _callback;
+    std::string _device;
+    int _threads = 1;
+    // batch image inputs are resized to, 0 keeps the model batch
+    int _batch = 0;
+    bool _xnnpack = true;
+    bool _dequantize = true;
+    // indexed by output, empty for float outputs and for outputs exposed quantized
+    std::vector<Quantization> _quantization;
+    int _xnnpackThreads = 1;
+    // operators taken by the delegate and left on builtin kernels, printed in the report
+    std::string _delegation;
+    bool _bindCores = false;
+    bool _profiling = false;
+    // shared with replicas
+    std::shared_ptr<tflite::FlatBufferModel> _model;
+#if defined(TFLITE_XNNPACK_WEIGHTS_CACHE)
+    // weights packed by XNNPACK for all interpreters, shared with replicas and destroyed after delegates
+    std::shared_ptr<TfLiteXNNPackDelegateWeightsCache> _weightsCache;
+#endif
+    // worker threads of requests must be stopped before interpreters are destroyed,
+    // async member is declared last in Request for this
+    std::vector<Request> _requests;
 };
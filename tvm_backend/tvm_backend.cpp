@@ -6,11 +6,60 @@
 #include <memory>
 #include <string>
 #include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <cstring>
 
 #include "tvm/runtime/module.h"
 #include "tvm/runtime/packed_func.h"
 #include "tvm/runtime/registry.h"
 
+static const char EXECUTOR[] = "EXECUTOR";
+static const char INPUT_SHAPE[] = "INPUT_SHAPE";
+static const char INPUT_PRECISION[] = "INPUT_PRECISION";
+static const char BENCHMARK[] = "BENCHMARK";
+static const char BENCHMARK_REPEAT[] = "BENCHMARK_REPEAT";
+static const char BENCHMARK_NUMBER[] = "BENCHMARK_NUMBER";
+static const char BENCHMARK_MIN_REPEAT_MS[] = "BENCHMARK_MIN_REPEAT_MS";
+
+static VShape parseShape(const std::string &value) {
+  VShape shape;
+  std::istringstream stream(value);
+  std::string dim;
+  while (std::getline(stream, dim, ',')) {
+    shape.push_back(std::stoul(dim));
+  }
+  return shape;
+}
+
+static evPrecision toPrecision(DLDataType type) {
+  if (type.lanes != 1) {
+    return UNSPECIFIED;
+  }
+  switch (type.code) {
+  case kDLFloat:
+    return type.bits == 32 ? FP32 : (type.bits == 16 ? FP16 : UNSPECIFIED);
+  case kDLUInt:
+    return type.bits == 8 ? U8 : (type.bits == 16 ? U16 : (type.bits == 64 ? U64 : UNSPECIFIED));
+  case kDLInt:
+    switch (type.bits) {
+    case 8:
+      return I8;
+    case 16:
+      return I16;
+    case 32:
+      return I32;
+    case 64:
+      return I64;
+    }
+    return UNSPECIFIED;
+  default:
+    return UNSPECIFIED;
+  }
+}
+
 bool TVMBackend::loadModel(const std::string &model, const std::string &device,
                           const std::vector<std::string> &outputs,
                           const std::map<std::string, std::string>& config) {
@@ -23,144 +72,613 @@ bool TVMBackend::loadModel(const std::string &model, const std::string &device,
     target = kDLMetal;
   }
   ctx_ = DLDevice{target, 0};
-  mod_factory_ = tvm::runtime::Module::LoadFromFile(model);
-  // create the graph runtime module
-  gmod_ = mod_factory_.GetFunction("default")(ctx_);
-  std::cout << "Call default Packed Func - DONE" <<std::endl;
-
-  tvm::runtime::PackedFunc get_num_inputs = gmod_.GetFunction("get_num_inputs");
-  tvm::runtime::PackedFunc get_input = gmod_.GetFunction("get_input");
-  tvm::runtime::PackedFunc get_num_outputs = gmod_.GetFunction("get_num_outputs");
-  tvm::runtime::PackedFunc get_output = gmod_.GetFunction("get_output");
-  setInput_ = gmod_.GetFunction("set_input");
-  getInput_ = gmod_.GetFunction("get_input");
-  getOutput_ = gmod_.GetFunction("get_output");
-  run_ = gmod_.GetFunction("run");
-
-  int ninputs = get_num_inputs();
-  ninputs = 1;
-  for (size_t i = 0; i < ninputs; i++) {
-    std::string name = "i" + std::to_string(i);
-    tvm::runtime::NDArray input = get_input(i);
-    auto shape = input.Shape();
-    if (shape.size() ==4) {
-      auto arr_type = input.DataType();
-      std::cout << "input: " << i << "(";
-      for (size_t i = 0; i < shape.size(); i++) {
-        std::cout << shape[i] << ",";
+
+  std::string executor = getConfigValue<std::string>(config, EXECUTOR, "GRAPH");
+  if (executor == "GRAPH") {
+    executor_ = kGraph;
+  } else if (executor == "AOT") {
+    executor_ = kAOT;
+  } else if (executor == "VM") {
+    executor_ = kVM;
+  } else {
+    std::cerr << "Unknown " << EXECUTOR << " " << executor << ", GRAPH, AOT or VM is expected" << std::endl;
+    return false;
+  }
+  benchmark_ = getConfigValue<std::string>(config, BENCHMARK, BackendConfig::NO) == BackendConfig::YES;
+  benchmarkRepeat_ = std::max(1, getConfigValue<int>(config, BENCHMARK_REPEAT, 3));
+  benchmarkNumber_ = std::max(1, getConfigValue<int>(config, BENCHMARK_NUMBER, 10));
+  benchmarkMinRepeatMs_ = std::max(0, getConfigValue<int>(config, BENCHMARK_MIN_REPEAT_MS, 0));
+
+  try {
+    mod_factory_ = tvm::runtime::Module::LoadFromFile(model);
+    if (executor_ == kVM) {
+      vmInputShape_ = parseShape(getConfigValue<std::string>(config, INPUT_SHAPE, ""));
+      vmInputPrecision_ = getConfigValue<std::string>(config, INPUT_PRECISION, "FP32") == "U8" ? U8 : FP32;
+      // bytecode is saved separately from the kernels library by Executable.save()
+      std::string codeFile = model.substr(0, model.find_last_of('.')) + ".ro";
+      std::ifstream code(codeFile, std::ios::binary);
+      if (!code) {
+        std::cerr << "Cannot read VM bytecode " << codeFile << std::endl;
+        return false;
+      }
+      std::string bytecode((std::istreambuf_iterator<char>(code)), std::istreambuf_iterator<char>());
+      const tvm::runtime::PackedFunc* loadExecutable = tvm::runtime::Registry::Get("runtime.Load_Executable");
+      if (!loadExecutable) {
+        std::cerr << "TVM runtime is built without Relay VM" << std::endl;
+        return false;
       }
-      std::cout << "), type: " << arr_type << std::endl;
+      vmExecutable_ = (*loadExecutable)(bytecode, mod_factory_);
+    }
+  } catch (std::exception &ex) {
+    std::cerr << ex.what() << std::endl;
+    return false;
+  }
+
+  // TVM has no streams, requests play role of streams
+  threads_ = std::max(0, getConfigValue<int>(config, BackendConfig::INFERENCE_THREADS, 0));
+  std::string profile = getConfigValue<std::string>(config, BackendConfig::PERFORMANCE_PROFILE, "");
+  threadsMode_ = profile == BackendConfig::PROFILE_POWER_SAVER ? kLittleCores : kBigCores;
+  configureThreads_ = threads_ > 0 || !profile.empty();
+  bindCores_ = getConfigValue<std::string>(config, BackendConfig::CPU_BIND, BackendConfig::NO) == BackendConfig::YES;
+  profiling_ = getConfigValue<std::string>(config, BackendConfig::PROFILING, BackendConfig::NO) == BackendConfig::YES;
+  // blocking infer() is executed by the calling thread
+  configureThreadPool();
+
+  size_t nireq = std::max<size_t>(1, getConfigValue<size_t>(config, BackendConfig::REQUESTS_NUM, 1));
+  return createRequests(nireq);
+}
 
-      IOInfo info;
-      if (arr_type.is_float()) {
-        info._precision = FP32;
-      } else if (arr_type.is_uint() && arr_type.bits() == 8) {
-        info._precision = U8;
+bool TVMBackend::createRequests(size_t nireq) {
+  requests_.resize(nireq);
+  if (executor_ == kVM) {
+    for (auto &request : requests_) {
+      request.gmod = createVirtualMachine();
+      request.setInput = request.gmod.GetFunction("set_input");
+      request.getOutput = request.gmod.GetFunction("get_output");
+      request.run = request.gmod.GetFunction("invoke_stateful");
+    }
+    if (indices_.empty() && !resolveVMTensors(requests_[0])) {
+      return false;
+    }
+  } else {
+    // the first graph executor created from the factory owns parameters. Next ones are created from the
+    // factory without parameters and bind them to the memory of the first one, so weights are kept only once.
+    // AOT executor has parameters compiled into the module, they are shared anyway
+    tvm::runtime::PackedFunc removeParams = mod_factory_.GetFunction("remove_params");
+    tvm::runtime::Module noParamsFactory = mod_factory_;
+    if (executor_ == kGraph && removeParams != nullptr) {
+      noParamsFactory = removeParams();
+    }
+    for (auto &request : requests_) {
+      if (!paramsOwner_.defined()) {
+        request.gmod = createExecutor(mod_factory_);
+        paramsOwner_ = request.gmod;
+        if (!resolveTensors(paramsOwner_)) {
+          return false;
+        }
       } else {
-        return false;
+        request.gmod = createExecutor(noParamsFactory);
+        if (executor_ == kGraph) {
+          shareParams(request.gmod);
+        }
+      }
+      request.setInput = request.gmod.GetFunction("set_input");
+      request.getOutput = request.gmod.GetFunction("get_output");
+      request.run = request.gmod.GetFunction("run");
+      if (profiling_ && executor_ == kGraph) {
+        // debug executor measures every fused operator while executing the graph
+        request.profile = request.gmod.GetFunction("profile");
       }
+    }
+  }
 
-      info._shape.resize(shape.size());
-      for (size_t j = 0; j < shape.size(); j++) {
-          info._shape[j] = shape[j];
+  if (profiling_ && executor_ != kGraph) {
+    std::cerr << "Profiling is available for graph executor only" << std::endl;
+  }
+
+  // AOT executor has no zero copy API, on CPU blobs look into its own arrays
+  zeroCopy_ = executor_ == kGraph && ctx_.device_type == kDLCPU;
+  bool executorArrays = executor_ == kAOT && ctx_.device_type == kDLCPU;
+  for (auto &request : requests_) {
+    tvm::runtime::PackedFunc setInputZeroCopy;
+    tvm::runtime::PackedFunc setOutputZeroCopy;
+    tvm::runtime::PackedFunc getInput;
+    if (zeroCopy_) {
+      setInputZeroCopy = request.gmod.GetFunction("set_input_zero_copy");
+      setOutputZeroCopy = request.gmod.GetFunction("set_output_zero_copy");
+    } else if (executorArrays) {
+      getInput = request.gmod.GetFunction("get_input");
+    }
+    request.arrays.resize(indices_.size());
+    request.blobs.resize(indices_.size());
+    for (size_t h = 0; h < indices_.size(); h++) {
+      tvm::runtime::NDArray array;
+      if (executorArrays) {
+        array = h < inputsNum_ ? getInput(indices_[h]) : request.getOutput(indices_[h]);
+      } else {
+        // host arrays are allocated with the alignment executor requires for zero copy
+        array = tvm::runtime::NDArray::Empty(shapes_[h], types_[h], DLDevice{kDLCPU, 0});
       }
-      _inputInfo[name] = info;
+      if (zeroCopy_) {
+        if (h < inputsNum_) {
+          setInputZeroCopy(indices_[h], array);
+        } else {
+          setOutputZeroCopy(indices_[h], array);
+        }
+      }
+      request.arrays[h] = array;
 
+      const IOInfo &info = h < inputsNum_ ? _inputInfo.at(names_[h]) : _outputInfo.at(names_[h]);
       auto vblob = std::make_shared<VBlob>();
       vblob->_precision = info._precision;
       vblob->_shape = info._shape;
-
-      DLDevice ctx{kDLCPU, 0}; //kDLMetal
-      x_ = tvm::runtime::NDArray::Empty(shape,
-        DLDataType{kDLFloat, 32, 1}, ctx);
-      //setInput(i, x_);
-      vblob->_data = reinterpret_cast<void *>(x_->data);
-      //vblob->_data = reinterpret_cast<void *>(input->data);
-      vblob->_ownMemory = false;
-      //size_t size = product(info._shape) * sizeof(float);
-      //vblob->_ownMemory = true;
-      //vblob->_data = (unsigned char *)malloc(size);
-
-      vblob->_layout = "NCHW";
-      vblob->_colourFormat = "RGB";
-      _blobs[name] = vblob;
+      if (h < inputsNum_ && info._shape.size() == 4) {
+        vblob->_layout = NCHW;
+        vblob->_colourFormat = RGB;
+      }
+      vblob->borrow(array->data);
+      request.blobs[h] = vblob;
     }
   }
 
-  int noutputs = get_num_outputs();
-  for (size_t i = 0; i < noutputs; i++) {
-    std::string name = "o" + std::to_string(i);
-    tvm::runtime::NDArray output = get_output(i);
-    auto shape = output.Shape();
-    auto arr_type = output.DataType();
+  for (size_t r = 0; r < nireq; r++) {
+    // thread pool of TVM runtime is thread local, every worker creates own one after it is pinned
+    size_t core = r * std::max(1, threads_);
+    requests_[r].async.reset(new AsyncInferRequest([this, r]() { return run(requests_[r]); },
+      [this, core]() {
+        if (bindCores_) {
+          pinCurrentThread(core, std::max(1, threads_));
+          configureThreadPool(core);
+        } else {
+          configureThreadPool();
+        }
+      }));
+  }
 
-    std::cout << "output: " << i << "(";
-    for (size_t i = 0; i < shape.size(); i++) {
-      std::cout << shape[i] << ",";
-    }
-    std::cout << ")" << std::endl;
+  return true;
+}
 
+bool TVMBackend::resolveTensors(tvm::runtime::Module gmod) {
+  tvm::runtime::PackedFunc getInput = gmod.GetFunction("get_input");
+  tvm::runtime::PackedFunc getOutput = gmod.GetFunction("get_output");
+  tvm::runtime::PackedFunc getInputInfo = gmod.GetFunction("get_input_info");
+  tvm::runtime::PackedFunc getInputIndex = gmod.GetFunction("get_input_index");
+  tvm::runtime::PackedFunc getInputName = gmod.GetFunction("get_input_name");
+  int noutputs = gmod.GetFunction("get_num_outputs")();
 
-    IOInfo info;
-    if (arr_type.is_float()) {
-      info._precision = FP32;
-    } else if (arr_type.is_uint() && arr_type.bits() == 8) {
-      info._precision = U8;
-    } else {
+  // parameters are inputs of the graph too, input info lists only data inputs
+  std::vector<std::pair<int, std::string> > inputs;
+  if (getInputInfo != nullptr) {
+    tvm::runtime::Map<tvm::runtime::String, tvm::runtime::ObjectRef> info = getInputInfo();
+    auto shapes = tvm::runtime::Downcast<tvm::runtime::Map<tvm::runtime::String, tvm::runtime::ObjectRef> >(info["shape"]);
+    for (auto item : shapes) {
+      std::string name = item.first;
+      int index = getInputIndex(name);
+      inputs.emplace_back(index, name);
+    }
+    std::sort(inputs.begin(), inputs.end());
+  } else if (executor_ == kAOT && getInputName != nullptr) {
+    // inputs of AOT executor are data inputs only
+    int ninputs = gmod.GetFunction("get_num_inputs")();
+    for (int i = 0; i < ninputs; i++) {
+      std::string name = getInputName(i);
+      inputs.emplace_back(i, name);
+    }
+  } else {
+    // older runtime cannot tell data inputs from parameters, the first input is taken as data
+    inputs.emplace_back(0, "input0");
+  }
+
+  for (auto &input : inputs) {
+    if (!addTensor(input.second, input.first, true, getInput(input.first))) {
+      return false;
+    }
+  }
+  // graph executor has no names of outputs, they are numbered
+  for (int o = 0; o < noutputs; o++) {
+    if (!addTensor("output" + std::to_string(o), o, false, getOutput(o))) {
       return false;
     }
+  }
+  return true;
+}
 
-    info._shape.resize(shape.size());
-    for (size_t j = 0; j < shape.size(); j++) {
-        info._shape[j] = shape[j];
+bool TVMBackend::resolveVMTensors(Request &request) {
+  tvm::runtime::PackedFunc getArity = vmExecutable_.GetFunction("get_function_arity");
+  tvm::runtime::PackedFunc getParamName = vmExecutable_.GetFunction("get_function_param_name");
+  int arity = getArity("main");
+  if (arity != 1 || vmInputShape_.empty()) {
+    std::cerr << "VM executor accepts models with one input, its shape is set by " << INPUT_SHAPE << std::endl;
+    return false;
+  }
+  std::string name = getParamName("main", 0);
+  tvm::runtime::ShapeTuple shape(vmInputShape_.begin(), vmInputShape_.end());
+  DLDataType type = vmInputPrecision_ == U8 ? DLDataType{kDLUInt, 8, 1} : DLDataType{kDLFloat, 32, 1};
+  tvm::runtime::NDArray input = tvm::runtime::NDArray::Empty(shape, type, DLDevice{kDLCPU, 0});
+  if (!addTensor(name, 0, true, input)) {
+    return false;
+  }
+
+  try {
+    request.setInput("main", input);
+    request.run("main");
+    int noutputs = request.gmod.GetFunction("get_num_outputs")();
+    for (int o = 0; o < noutputs; o++) {
+      if (!addTensor("output" + std::to_string(o), o, false, request.getOutput(o))) {
+        return false;
+      }
     }
-    _outputInfo[name] = info;
+  } catch (std::exception &ex) {
+    std::cerr << "Cannot run VM to get its outputs: " << ex.what() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool TVMBackend::addTensor(const std::string &name, int index, bool isInput, const tvm::runtime::NDArray &array) {
+  IOInfo info;
+  info._precision = toPrecision(array.DataType());
+  if (info._precision == UNSPECIFIED) {
+    std::cerr << "Tensor " << name << " has unsupported type " << array.DataType() << std::endl;
+    return false;
+  }
+  tvm::runtime::ShapeTuple shape = array.Shape();
+  info._shape.assign(shape.begin(), shape.end());
+  (isInput ? _inputInfo : _outputInfo)[name] = info;
+  if (isInput) {
+    inputsNum_++;
+  }
 
-    auto vblob = std::make_shared<VBlob>();
-    vblob->_precision = info._precision;
-    vblob->_shape = info._shape;
-    DLDevice ctx{kDLCPU, 0}; //kDLMetal
-    y_ = tvm::runtime::NDArray::Empty(shape,
-      DLDataType{kDLFloat, 32, 1}, ctx);
-    vblob->_data = reinterpret_cast<void *>(y_->data);
-    //vblob->_data = reinterpret_cast<void *>(output->data);
-    vblob->_ownMemory = false;
-    _blobs[name] = vblob;
+  std::cout << (isInput ? "input: " : "output: ") << name << "(";
+  for (auto dim : info._shape) {
+    std::cout << dim << ",";
   }
+  std::cout << "), type: " << array.DataType() << std::endl;
 
+  _handles[name] = indices_.size();
+  indices_.push_back(index);
+  names_.push_back(name);
+  shapes_.push_back(shape);
+  types_.push_back(array.DataType());
   return true;
 }
 
+tvm::runtime::Module TVMBackend::createVirtualMachine() {
+  const tvm::runtime::PackedFunc* createVM = tvm::runtime::Registry::Get("runtime._VirtualMachine");
+  tvm::runtime::Module vm = (*createVM)(vmExecutable_);
+  // device, device id and allocator for each device, host is the last one. Pooled allocator reuses memory of
+  // the previous invocation
+  const int pooledAllocator = 2;
+  if (ctx_.device_type == kDLCPU) {
+    vm.GetFunction("init")(static_cast<int>(ctx_.device_type), ctx_.device_id, pooledAllocator);
+  } else {
+    vm.GetFunction("init")(static_cast<int>(ctx_.device_type), ctx_.device_id, pooledAllocator,
+                           static_cast<int>(kDLCPU), 0, pooledAllocator);
+  }
+  return vm;
+}
+
+tvm::runtime::Module TVMBackend::createExecutor(tvm::runtime::Module factory) {
+  if (profiling_ && executor_ == kGraph) {
+    tvm::runtime::PackedFunc debugCreate = factory.GetFunction("debug_create");
+    if (debugCreate != nullptr) {
+      return debugCreate("default", ctx_);
+    }
+    std::cerr << "TVM runtime is built without debug executor, profiling is not available" << std::endl;
+  }
+  return factory.GetFunction("default")(ctx_);
+}
+
+void TVMBackend::configureThreadPool() {
+  if (!configureThreads_) {
+    return;
+  }
+  const tvm::runtime::PackedFunc* configThreadPool = tvm::runtime::Registry::Get("runtime.config_threadpool");
+  if (configThreadPool) {
+    (*configThreadPool)(static_cast<int>(threadsMode_), threads_);
+  }
+}
+
+void TVMBackend::configureThreadPool(size_t firstCore) {
+  const tvm::runtime::PackedFunc* configThreadPool = tvm::runtime::Registry::Get("runtime.config_threadpool");
+  if (!configThreadPool) {
+    return;
+  }
+  // TVM pins workers of the pool itself, to big or little cores of the whole system unless the cores are given
+  int threads = std::max(1, threads_);
+  size_t ncores = std::max(1u, std::thread::hardware_concurrency());
+  tvm::runtime::Array<tvm::runtime::String> cpus;
+  for (int c = 0; c < threads; c++) {
+    cpus.push_back(std::to_string((firstCore + c) % ncores));
+  }
+  (*configThreadPool)(static_cast<int>(kSpecifiedCores), threads, cpus);
+}
+
+void TVMBackend::shareParams(tvm::runtime::Module gmod) {
+  // graph executor keeps parameters as inputs, every input except of data inputs is a parameter
+  tvm::runtime::PackedFunc getNumInputs = gmod.GetFunction("get_num_inputs");
+  tvm::runtime::PackedFunc setInputZeroCopy = gmod.GetFunction("set_input_zero_copy");
+  tvm::runtime::PackedFunc getOwnerInput = paramsOwner_.GetFunction("get_input");
+  int ninputs = getNumInputs();
+  for (int i = 0; i < ninputs; i++) {
+    if (std::find(indices_.begin(), indices_.begin() + inputsNum_, i) != indices_.begin() + inputsNum_) {
+      continue;
+    }
+    tvm::runtime::NDArray param = getOwnerInput(i);
+    setInputZeroCopy(i, param);
+  }
+}
+
+Backend* TVMBackend::createReplica() {
+  if (requests_.empty()) {
+    return nullptr;
+  }
+  TVMBackend* replica = new TVMBackend();
+  replica->_allocator = _allocator;
+  replica->ctx_ = ctx_;
+  replica->mod_factory_ = mod_factory_;
+  replica->paramsOwner_ = paramsOwner_;
+  replica->indices_ = indices_;
+  replica->names_ = names_;
+  replica->shapes_ = shapes_;
+  replica->types_ = types_;
+  replica->inputsNum_ = inputsNum_;
+  replica->vmExecutable_ = vmExecutable_;
+  replica->executor_ = executor_;
+  replica->vmInputShape_ = vmInputShape_;
+  replica->vmInputPrecision_ = vmInputPrecision_;
+  replica->benchmark_ = benchmark_;
+  replica->benchmarkRepeat_ = benchmarkRepeat_;
+  replica->benchmarkNumber_ = benchmarkNumber_;
+  replica->benchmarkMinRepeatMs_ = benchmarkMinRepeatMs_;
+  replica->_handles = _handles;
+  replica->_inputInfo = _inputInfo;
+  replica->_outputInfo = _outputInfo;
+  replica->threads_ = threads_;
+  replica->threadsMode_ = threadsMode_;
+  replica->configureThreads_ = configureThreads_;
+  replica->bindCores_ = bindCores_;
+  replica->profiling_ = profiling_;
+  try {
+    if (!replica->createRequests(requests_.size())) {
+      delete replica;
+      return nullptr;
+    }
+  } catch (std::exception&) {
+    delete replica;
+    return nullptr;
+  }
+  return replica;
+}
+
 void TVMBackend::report(const InferenceMetrics &im) const {
+  if (benchmark_) {
+    benchmark();
+  }
+  if (profiling_) {
+    printProfile(std::cout, getProfile());
+  }
+}
+
+void TVMBackend::benchmark() const {
+  const tvm::runtime::PackedFunc* timeEvaluator = tvm::runtime::Registry::Get("runtime.RPCTimeEvaluator");
+  if (!timeEvaluator || requests_.empty()) {
+    std::cerr << "TVM runtime has no time evaluator" << std::endl;
+    return;
+  }
+  tvm::runtime::Module gmod = requests_[0].gmod;
+  std::string name = executor_ == kVM ? "invoke_stateful" : "run";
+  int deviceType = static_cast<int>(ctx_.device_type);
+  tvm::runtime::PackedFunc evaluator;
+  // arguments were added to the evaluator by runtime versions: cooldown interval and repeats to cooldown (0.9),
+  // limit of zero time iterations (0.10) and size of flushed cache. The newest signature is tried first
+  try {
+    evaluator = (*timeEvaluator)(gmod, name, deviceType, ctx_.device_id, benchmarkNumber_, benchmarkRepeat_,
+                                 benchmarkMinRepeatMs_, 100, 0, 1, 0, "");
+  } catch (std::exception&) {
+  }
+  if (evaluator == nullptr) {
+    try {
+      evaluator = (*timeEvaluator)(gmod, name, deviceType, ctx_.device_id, benchmarkNumber_, benchmarkRepeat_,
+                                   benchmarkMinRepeatMs_, 100, 0, 1, "");
+    } catch (std::exception&) {
+    }
+  }
+  if (evaluator == nullptr) {
+    try {
+      evaluator = (*timeEvaluator)(gmod, name, deviceType, ctx_.device_id, benchmarkNumber_, benchmarkRepeat_,
+                                   benchmarkMinRepeatMs_, 0, 1, "");
+    } catch (std::exception&) {
+    }
+  }
+  if (evaluator == nullptr) {
+    try {
+      evaluator = (*timeEvaluator)(gmod, name, deviceType, ctx_.device_id, benchmarkNumber_, benchmarkRepeat_,
+                                   benchmarkMinRepeatMs_, "");
+    } catch (std::exception &ex) {
+      std::cerr << "TVM runtime has no time evaluator of known signature: " << ex.what() << std::endl;
+      return;
+    }
+  }
+  std::string results;
+  try {
+    results = executor_ == kVM ? std::string(evaluator("main")) : std::string(evaluator());
+  } catch (std::exception &ex) {
+    std::cerr << "time_evaluator failed: " << ex.what() << std::endl;
+    return;
+  }
+  // one mean time in seconds per repeat
+  std::vector<double> times(results.size() / sizeof(double));
+  if (times.empty()) {
+    return;
+  }
+  memcpy(times.data(), results.data(), times.size() * sizeof(double));
+  double sum = 0;
+  for (double time : times) {
+    sum += time;
+  }
+  std::cout << "Executor run by time_evaluator (ms): mean " << 1000. * sum / times.size()
+            << ", min " << 1000. * *std::min_element(times.begin(), times.end())
+            << ", max " << 1000. * *std::max_element(times.begin(), times.end())
+            << " (" << times.size() << " repeats of " << benchmarkNumber_ << " runs)" << std::endl;
+}
 
+VProfile TVMBackend::getProfile() const {
+  std::vector<const std::map<std::string, LayerProfile>*> profiles;
+  for (auto &request : requests_) {
+    profiles.push_back(&request.layers);
+  }
+  return mergeProfiles(profiles);
 }
-bool TVMBackend::infer() {
+
+void TVMBackend::execute(Request &request) {
+  if (request.profile == nullptr) {
+    if (executor_ == kVM) {
+      request.run("main");
+    } else {
+      request.run();
+    }
+    return;
+  }
+  tvm::runtime::profiling::Report report =
+    request.profile(tvm::runtime::Array<tvm::runtime::profiling::MetricCollector>())
+      .AsObjectRef<tvm::runtime::profiling::Report>();
+  for (auto call : report->calls) {
+    // fused functions are named like tvmgen_default_fused_nn_conv2d_add, the part after "fused_" is the type
+    std::string name = tvm::runtime::Downcast<tvm::runtime::String>(call.at("Name"));
+    size_t fused = name.find("fused_");
+    std::string type = fused != std::string::npos ? name.substr(fused + 6) : name;
+    const auto* duration = call.at("Duration (us)").as<tvm::runtime::profiling::DurationNode>();
+    if (duration) {
+      addLayerTime(request.layers, name, type, duration->microseconds / 1000.);
+    }
+  }
+}
+
+bool TVMBackend::run(Request &request) {
     try {
-      setInput_(0, x_);
-      run_();
-      tvm::runtime::NDArray output = getOutput_(0);
-      output.CopyTo(y_);
-      TVMSynchronize(ctx_.device_type, ctx_.device_id, nullptr);
+      if (ctx_.device_type == kDLCPU && executor_ != kVM) {
+        // arrays of blobs are bound to the executor or are its own ones, nothing to copy
+        execute(request);
         return true;
+      }
+      // VM takes host input as is and allocates outputs itself on every invocation
+      for (size_t h = 0; h < inputsNum_; h++) {
+        if (executor_ == kVM) {
+          request.setInput("main", request.arrays[h]);
+        } else {
+          request.setInput(indices_[h], request.arrays[h]);
+        }
+      }
+      execute(request);
+      for (size_t h = inputsNum_; h < indices_.size(); h++) {
+        tvm::runtime::NDArray output = request.getOutput(indices_[h]);
+        output.CopyTo(request.arrays[h]);
+      }
+      TVMSynchronize(ctx_.device_type, ctx_.device_id, nullptr);
+      return true;
     } catch (std::exception&) {
       return false;
     }
 }
 
+bool TVMBackend::infer() {
+  return run(requests_[0]);
+}
+
+size_t TVMBackend::getRequestsNum() const {
+  return requests_.size();
+}
+
+bool TVMBackend::startAsync(size_t request) {
+  if (request >= requests_.size()) {
+    return false;
+  }
+  return requests_[request].async->start([this, request](bool status) {
+    if (callback_) {
+      callback_(request, status);
+    }
+  });
+}
+
+bool TVMBackend::wait(size_t request) {
+  if (request >= requests_.size()) {
+    return false;
+  }
+  return requests_[request].async->wait();
+}
+
+void TVMBackend::setCompletionCallback(CompletionCallback callback) {
+  callback_ = callback;
+}
+
 std::shared_ptr<VBlob> TVMBackend::getBlob(const std::string &name) {
-    return _blobs[name];
+    return getBlob(name, 0);
+}
+
+std::shared_ptr<VBlob> TVMBackend::getBlob(const std::string &name, size_t request) {
+  TensorHandle handle = getTensorHandle(name);
+  if (handle == INVALID_TENSOR_HANDLE) {
+    return nullptr;
+  }
+  return requests_.at(request).blobs[handle];
+}
+
+TensorHandle TVMBackend::getTensorHandle(const std::string &name) const {
+  auto it = _handles.find(name);
+  return it != _handles.end() ? it->second : INVALID_TENSOR_HANDLE;
 }
 
+VBlob* TVMBackend::getBlob(TensorHandle handle, size_t request) {
+  return requests_[request].blobs[handle].get();
+}
+
+bool TVMBackend::bindBlob(const std::string &name, std::shared_ptr<VBlob> blob, size_t request) {
+  // executor accepts external memory only from the host and aligned as its own allocations
+  if (request >= requests_.size() || !blob || !blob->_data || !zeroCopy_ ||
+      reinterpret_cast<uintptr_t>(blob->_data) % kAllocAlignment != 0) {
+    return false;
+  }
+  TensorHandle handle = getTensorHandle(name);
+  if (handle == INVALID_TENSOR_HANDLE) {
+    return false;
+  }
+  bool isInput = handle < inputsNum_;
+  const IOInfo &info = isInput ? _inputInfo[name] : _outputInfo[name];
+  if (blob->_shape != info._shape || blob->_precision != info._precision || !blob->_strides.empty()) {
+    return false;
+  }
+
+  Request &req = requests_[request];
+  std::vector<int64_t> shape(blob->_shape.begin(), blob->_shape.end());
+  DLTensor tensor;
+  tensor.data = blob->_data;
+  tensor.device = ctx_;
+  tensor.ndim = static_cast<int>(shape.size());
+  tensor.dtype = types_[handle];
+  tensor.shape = shape.data();
+  tensor.strides = nullptr;
+  tensor.byte_offset = 0;
+  try {
+    tvm::runtime::NDArray array = tvm::runtime::NDArray::FromExternalDLTensor(tensor);
+    req.gmod.GetFunction(isInput ? "set_input_zero_copy" : "set_output_zero_copy")(indices_[handle], array);
+    req.arrays[handle] = array;
+  } catch (std::exception&) {
+    return false;
+  }
+  req.blobs[handle] = blob;
+  return true;
+}
 
 void TVMBackend::release() {
   delete this;
 }
 
-VInputInfo TVMBackend::getInputDataMap() const {
+const VInputInfo& TVMBackend::getInputDataMap() const {
   return _inputInfo;
 }
 
-VOutputInfo TVMBackend::getOutputDataMap() const {
+const VOutputInfo& TVMBackend::getOutputDataMap() const {
   return _outputInfo;
 }
 
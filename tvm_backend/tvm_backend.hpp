@@ -2,12 +2,23 @@
 // Use of this source code is governed by a BSD-style license
 
 #include "backend.hpp"
+#include "async_infer_request.hpp"
 #include "tvm/runtime/module.h"
+#include "tvm/runtime/profiling.h"
 
 extern "C" {
 Backend* createBackend();
 }
 
+/**
+ * Backend on top of TVM runtime. Backend specific config keys:
+ *   EXECUTOR    - GRAPH (default) or AOT for module exported by relay.build, VM for Relay VM executable,
+ *                 its bytecode is read from the file next to the module with .ro extension
+ *   INPUT_SHAPE - comma separated shape of VM input, VM executable does not keep it
+ *   INPUT_PRECISION - FP32 (default) or U8 input of VM
+ *   BENCHMARK   - YES measures run of the executor by time_evaluator of the runtime and prints it in the report
+ *   BENCHMARK_REPEAT, BENCHMARK_NUMBER, BENCHMARK_MIN_REPEAT_MS - parameters of time_evaluator, 3, 10 and 0
+ */
 class TVMBackend : public Backend {
 public:
   virtual bool loadModel(const std::string &model, const std::string &device,
@@ -18,27 +29,100 @@ public:
       return nullptr;
   }
   virtual void report(const InferenceMetrics &im) const override;
+  virtual VProfile getProfile() const override;
   virtual bool infer()override;
+  virtual Backend* createReplica()override;
   virtual void release()override;
 
+  virtual size_t getRequestsNum() const override;
+  virtual bool startAsync(size_t request)override;
+  virtual bool wait(size_t request)override;
+  virtual void setCompletionCallback(CompletionCallback callback)override;
+
   virtual std::shared_ptr<VBlob> getBlob(const std::string &name)override;
+  virtual std::shared_ptr<VBlob> getBlob(const std::string &name, size_t request)override;
+  virtual TensorHandle getTensorHandle(const std::string &name) const override;
+  virtual VBlob* getBlob(TensorHandle handle, size_t request)override;
+  virtual bool bindBlob(const std::string &name, std::shared_ptr<VBlob> blob, size_t request)override;
 
-  virtual VInputInfo getInputDataMap() const override;
-  virtual VOutputInfo getOutputDataMap() const override;
+  virtual const VInputInfo& getInputDataMap() const override;
+  virtual const VOutputInfo& getOutputDataMap() const override;
 
 protected:
-  tvm::runtime::PackedFunc run_;
-  tvm::runtime::PackedFunc setInput_;
-  tvm::runtime::PackedFunc getInput_;
-  tvm::runtime::PackedFunc getOutput_;
-  tvm::runtime::Module gmod_;
+  // alignment of NDArray allocations, external memory must follow it for zero copy
+  static const size_t kAllocAlignment = 64;
+
+  enum Executor { kGraph, kAOT, kVM };
+
+  struct Request {
+    // run of graph and AOT executors, invoke_stateful of VM
+    tvm::runtime::PackedFunc run;
+    // defined only for debug executor created in profiling mode
+    tvm::runtime::PackedFunc profile;
+    tvm::runtime::PackedFunc setInput;
+    tvm::runtime::PackedFunc getOutput;
+    tvm::runtime::Module gmod;
+    // host arrays blobs look into, indexed by tensor handle. On CPU executor reads and writes them in place,
+    // for other devices they are copied to and from the executor
+    std::vector<tvm::runtime::NDArray> arrays;
+    // indexed by tensor handle
+    std::vector<std::shared_ptr<VBlob> > blobs;
+    std::map<std::string, LayerProfile> layers;
+    std::unique_ptr<AsyncInferRequest> async;
+  };
+
+  bool createRequests(size_t nireq);
+  // resolves data inputs and outputs of executor having parameters
+  bool resolveTensors(tvm::runtime::Module gmod);
+  // VM knows shapes of outputs only after invocation, the request is run once
+  bool resolveVMTensors(Request &request);
+  bool addTensor(const std::string &name, int index, bool isInput, const tvm::runtime::NDArray &array);
+  tvm::runtime::Module createVirtualMachine();
+  // mean, min and max time of executor run measured by the runtime
+  void benchmark() const;
+  void shareParams(tvm::runtime::Module gmod);
+  bool run(Request &request);
+  // runs the graph, collects per-operator time if the request is profiled
+  void execute(Request &request);
+  tvm::runtime::Module createExecutor(tvm::runtime::Module factory);
+  void configureThreadPool();
+  // pool of INFERENCE_THREADS workers pinned one per core from firstCore on
+  void configureThreadPool(size_t firstCore);
+
   DLDevice ctx_;
   // TODO: which object retain TVM network not to be released?
   tvm::runtime::Module mod_factory_;
-  tvm::runtime::NDArray x_, y_;
-
-  std::map<std::string, std::shared_ptr<VBlob> > _blobs;
+  // graph executor holding parameters shared by all requests and replicas
+  tvm::runtime::Module paramsOwner_;
+  // VM executable, constants are shared by all virtual machines created from it
+  tvm::runtime::Module vmExecutable_;
+  Executor executor_ = kGraph;
+  // executor binds host arrays by set_input_zero_copy and set_output_zero_copy
+  bool zeroCopy_ = false;
+  VShape vmInputShape_;
+  evPrecision vmInputPrecision_ = FP32;
+  bool benchmark_ = false;
+  int benchmarkRepeat_ = 3;
+  int benchmarkNumber_ = 10;
+  int benchmarkMinRepeatMs_ = 0;
+  // executor indices of data inputs followed by indices of outputs, in the order of handles
+  std::vector<int> indices_;
+  std::vector<std::string> names_;
+  std::vector<tvm::runtime::ShapeTuple> shapes_;
+  std::vector<DLDataType> types_;
+  size_t inputsNum_ = 0;
+  // affinity modes of TVM thread pool, cores are specified since TVM 0.9
+  enum ThreadsMode { kBigCores = 1, kLittleCores = -1, kSpecifiedCores = -2 };
+  // 0 lets runtime to decide
+  int threads_ = 0;
+  ThreadsMode threadsMode_ = kBigCores;
+  bool configureThreads_ = false;
+  bool bindCores_ = false;
+  bool profiling_ = false;
+  CompletionCallback callback_;
+  std::vector<Request> requests_;
 
   VInputInfo _inputInfo;
   VOutputInfo _outputInfo;
+  std::map<std::string, TensorHandle> _handles;
 };
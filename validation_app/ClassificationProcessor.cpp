@@ -11,10 +11,11 @@
 #include "Processor.hpp"
 
 ClassificationProcessor::ClassificationProcessor(Backend *backend, const std::string &flags_m, const std::vector<std::string> &outputs,
+                                                 const std::map<std::string, std::string> &config,
                                                  const std::string &flags_d, const std::string &flags_i, int flags_b,
         CsvDumper& dumper, const std::string& flags_l,
         PreprocessingOptions preprocessingOptions, bool zeroBackground)
-    : Processor(backend, flags_m, outputs, flags_d, flags_i, flags_b, dumper, "Classification network", preprocessingOptions), zeroBackground(zeroBackground) {
+    : Processor(backend, flags_m, outputs, config, flags_d, flags_i, flags_b, dumper, "Classification network", preprocessingOptions), zeroBackground(zeroBackground) {
 
     // Change path to labels file if necessary
     if (flags_l.empty()) {
@@ -25,13 +26,15 @@ ClassificationProcessor::ClassificationProcessor(Backend *backend, const std::st
 }
 
 ClassificationProcessor::ClassificationProcessor(Backend *backend, const std::string &flags_m, const std::vector<std::string> &outputs,
+                                                 const std::map<std::string, std::string> &config,
                                                  const std::string &flags_d, const std::string &flags_i, int flags_b,
                                                  CsvDumper &dumper, const std::string &flags_l, bool zeroBackground)
-    : ClassificationProcessor(backend, flags_m, outputs, flags_d, flags_i, flags_b, dumper, flags_l,
+    : ClassificationProcessor(backend, flags_m, outputs, config, flags_d, flags_i, flags_b, dumper, flags_l,
             PreprocessingOptions(false, ResizeCropPolicy::ResizeThenCrop, 256, 256), zeroBackground) {
 }
 
-inline void TopResults(unsigned int n, shared_ptr<VBlob> input, std::vector<unsigned> &output) {
+template <typename T>
+inline void TopResults(unsigned int n, const VBlob* input, std::vector<unsigned> &output) {
     VShape dims = input->_shape;
     size_t input_rank = dims.size();
     if (!input_rank || !dims[0])
@@ -46,7 +49,7 @@ inline void TopResults(unsigned int n, shared_ptr<VBlob> input, std::vector<unsi
 
     for (size_t i = 0; i < batchSize; i++) {
         size_t offset = i *(blobSize / batchSize);
-        float *batchData = static_cast<float*>(input->_data);
+        const T *batchData = static_cast<const T*>(input->_data);
         batchData += offset;
 
         std::iota(std::begin(indexes), std::end(indexes), 0);
@@ -60,71 +63,130 @@ inline void TopResults(unsigned int n, shared_ptr<VBlob> input, std::vector<unsi
     }
 }
 
+/**
+ * Per tensor quantization keeps the order of values, so top classes of quantized output are found
+ * without dequantization of the whole output
+ */
+inline void TopResults(unsigned int n, const VBlob* input, std::vector<unsigned> &output) {
+    switch (input->_precision) {
+    case U8:
+        TopResults<uint8_t>(n, input, output);
+        break;
+    case I8:
+        TopResults<int8_t>(n, input, output);
+        break;
+    default:
+        TopResults<float>(n, input, output);
+    }
+}
+
+inline float BlobValue(const VBlob* blob, size_t index) {
+    switch (blob->_precision) {
+    case U8:
+        return (static_cast<const uint8_t*>(blob->_data)[index] - blob->_zeroPoint) * blob->_scale;
+    case I8:
+        return (static_cast<const int8_t*>(blob->_data)[index] - blob->_zeroPoint) * blob->_scale;
+    default:
+        return static_cast<const float*>(blob->_data)[index];
+    }
+}
+
 
 std::shared_ptr<Processor::InferenceMetrics> ClassificationProcessor::Process(bool stream_output) {
      slog::info << "Collecting labels" << slog::endl;
      ClassificationSetGenerator generator;
 
      auto validationMap = generator.getValidationMap(imagesPath);
-     ImageDecoder decoder;
 
      // ----------------------------Do inference-------------------------------------------------------------
      slog::info << "Starting inference" << slog::endl;
 
-     std::vector<int> expected(batch);
-     std::vector<std::string> files(batch);
-
      ConsoleProgress progress(validationMap.size(), stream_output);
 
      ClassificationInferenceMetrics im;
 
-     std::string firstInputName = this->_inputInfo.begin()->first;
-     std::string firstOutputName = this->_outputInfo.begin()->first;
-     auto firstInputBlob = _backend->getBlob(firstInputName);
-     auto firstOutputBlob = _backend->getBlob(firstOutputName);
+     // tensors are resolved once, the loop below accesses blobs by handles
+     const std::string firstInputName = this->_inputInfo.begin()->first;
+     TensorHandle firstOutput = _backend->getTensorHandle(this->_outputInfo.begin()->first);
 
+     // every request has own batch of images, requests are started and collected in round robin
+     // order, so while one request is inferred the next batch is decoded into the other one
+     std::vector<std::vector<int>> expected(nireq, std::vector<int>(batch));
+     std::vector<std::vector<std::string>> files(nireq, std::vector<std::string>(batch));
+     std::vector<size_t> images(nireq, 0);
+     std::vector<int> watched(nireq, 0);
+     std::vector<bool> inFlight(nireq, false);
 
-     auto iter = validationMap.begin();
-     while (iter != validationMap.end()) {
-         size_t b = 0;
-         int filesWatched = 0;
-         for (; b < batch && iter != validationMap.end(); b++, iter++, filesWatched++) {
-             expected[b] = iter->first;
-             try {
-                 decoder.insertIntoBlob(iter->second, b, firstInputBlob, preprocessingOptions);
-                 files[b] = iter->second;
-             } catch (const std::exception& iex) {
-                 slog::warn << "Can't read file " << iter->second << slog::endl;
-                 slog::warn << "Error: " << iex.what() << slog::endl;
-                 // Could be some non-image file in directory
-                 b--;
-                 continue;
-             }
-         }
-         Infer(progress, filesWatched, im);
+     auto collectResults = [&](size_t r) {
+         WaitInfer(r, progress, watched[r], im);
+         inFlight[r] = false;
 
+         VBlob* firstOutputBlob = _backend->getBlob(firstOutput, r);
          std::vector<unsigned> results;
-         auto firstOutputData = static_cast<float*>(firstOutputBlob->_data);
          TopResults(TOP_COUNT, firstOutputBlob, results);
 
-         for (size_t i = 0; i < b; i++) {
-             int expc = expected[i];
+         for (size_t i = 0; i < images[r]; i++) {
+             int expc = expected[r][i];
              if (zeroBackground) expc++;
 
              bool top1Scored = (static_cast<int>(results[0 + TOP_COUNT * i]) == expc);
-             dumper << "\"" + files[i] + "\"" << top1Scored;
+             dumper << "\"" + files[r][i] + "\"" << top1Scored;
              if (top1Scored) im.top1Result++;
              for (int j = 0; j < TOP_COUNT; j++) {
                  unsigned classId = results[j + TOP_COUNT * i];
                  if (static_cast<int>(classId) == expc) {
                      im.topCountResult++;
                  }
-                 dumper << classId << firstOutputData[classId + i * (product(firstOutputBlob->_shape) / batch)];
+                 dumper << classId << BlobValue(firstOutputBlob, classId + i * (product(firstOutputBlob->_shape) / batch));
              }
              dumper.endLine();
              im.total++;
          }
+     };
+
+     // images are decoded ahead in the order of the loop below
+     std::vector<std::string> imageFiles;
+     for (auto& item : validationMap) {
+         imageFiles.push_back(item.second);
+     }
+     std::unique_ptr<ImagePrefetcher> prefetcher = StartDecoding(imageFiles, firstInputName);
+
+     auto startTime = Clock::now();
+     size_t r = 0;
+     auto iter = validationMap.begin();
+     while (iter != validationMap.end()) {
+         if (inFlight[r]) {
+             collectResults(r);
+         }
+
+         size_t b = 0;
+         int filesWatched = 0;
+         for (; b < batch && iter != validationMap.end(); b++, iter++, filesWatched++) {
+             expected[r][b] = iter->first;
+             try {
+                 LoadImage(*prefetcher, b, r, firstInputName, im);
+                 files[r][b] = iter->second;
+             } catch (const std::exception& iex) {
+                 slog::warn << "Can't read file " << iter->second << slog::endl;
+                 slog::warn << "Error: " << iex.what() << slog::endl;
+                 // Could be some non-image file in directory
+                 b--;
+                 continue;
+             }
+         }
+         images[r] = b;
+         watched[r] = filesWatched;
+         StartInfer(r);
+         inFlight[r] = true;
+         r = (r + 1) % nireq;
+     }
+     // collect the rest of requests keeping the order they were started in
+     for (size_t i = 0; i < nireq; i++, r = (r + 1) % nireq) {
+         if (inFlight[r]) {
+             collectResults(r);
+         }
      }
+     im.wallTime = std::chrono::duration_cast<std::chrono::duration<double, std::ratio<1, 1000>>>(Clock::now() - startTime).count();
      progress.finish();
 
      return std::shared_ptr<Processor::InferenceMetrics>(new ClassificationInferenceMetrics(im));
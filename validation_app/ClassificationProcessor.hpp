@@ -29,10 +29,12 @@ protected:
     bool zeroBackground;
 public:
     ClassificationProcessor(Backend *backend, const std::string &flags_m, const std::vector<std::string> &outputs,
+                            const std::map<std::string, std::string> &config,
                             const std::string &flags_d, const std::string &flags_i, int flags_b,
             CsvDumper& dumper, const std::string& flags_l,
             PreprocessingOptions preprocessingOptions, bool zeroBackground);
     ClassificationProcessor(Backend *backend, const std::string &flags_m, const std::vector<std::string> &outputs,
+                            const std::map<std::string, std::string> &config,
                             const std::string &flags_d, const std::string &flags_i, int flags_b,
             CsvDumper& dumper, const std::string& flags_l, bool zeroBackground);
 
@@ -18,23 +18,32 @@
 #include <samples/slog.hpp>
 
 ObjectDetectionProcessor::ObjectDetectionProcessor(Backend *backend, const std::string &flags_m, const std::vector<std::string> &outputs,
+                                                   const std::map<std::string, std::string> &config,
                                                    const std::string &flags_d,
         const std::string& flags_i, const std::string& subdir, int flags_b,
         double threshold, CsvDumper& dumper,
         const std::string& flags_a, const std::string& classes_list_file, PreprocessingOptions preprocessingOptions, bool scaleProposalToInputSize)
-        : Processor(backend, flags_m, outputs, flags_d, flags_i, flags_b, dumper, "Object detection network", preprocessingOptions),
+        : Processor(backend, flags_m, outputs, config, flags_d, flags_i, flags_b, dumper, "Object detection network", preprocessingOptions),
               annotationsPath(flags_a), subdir(subdir), threshold(threshold), scaleProposalToInputSize(scaleProposalToInputSize) {
+    for (auto &item : _outputInfo) {
+        if (_backend->getBlob(_backend->getTensorHandle(item.first), 0)->_precision != FP32) {
+            THROW_USER_EXCEPTION(1) << "Output " << item.first << " is quantized, detections are parsed from FP32 outputs only";
+        }
+    }
     // To support faster-rcnn having several inputs we need to identify input dedicated for image correctly
     for (auto &item : _inputInfo) {
         if (item.second._shape.size() == 4) {
             inputDims = item.second._shape;
             picInputName = item.first;
+            picInput = _backend->getTensorHandle(picInputName);
         } else if (item.second._shape.size() == 2) {
-            auto inputScale = _backend->getBlob(item.first);
-            float *sdata = static_cast<float *>(inputScale->_data);
-            sdata[0] = 600.f;
-            sdata[1] = 1024.f;
-            sdata[2] = 1.f;
+            for (size_t r = 0; r < nireq; r++) {
+                auto inputScale = _backend->getBlob(item.first, r);
+                float *sdata = static_cast<float *>(inputScale->_data);
+                sdata[0] = 600.f;
+                sdata[1] = 1024.f;
+                sdata[2] = 1.f;
+            }
         }
     }
 
@@ -93,8 +102,6 @@ shared_ptr<Processor::InferenceMetrics> ObjectDetectionProcessor::Process(bool s
     // ----------------------------Do inference-------------------------------------------------------------
     slog::info << "Starting inference" << slog::endl;
 
-    std::vector<VOCAnnotation> expected(batch);
-
     ConsoleProgress progress(annCollector.annotations().size(), stream_output);
 
     ObjectDetectionInferenceMetrics im(threshold);
@@ -103,39 +110,77 @@ shared_ptr<Processor::InferenceMetrics> ObjectDetectionProcessor::Process(bool s
 
     std::map<std::string, ImageDescription> scaledDesiredForFiles;
 
-    auto firstInputBlob = _backend->getBlob(picInputName);
+    // every request has own batch of images, requests are started and collected in round robin
+    // order, so while one request is inferred the next batch is decoded into the other one
+    std::vector<std::vector<std::string>> files(nireq);
+    std::vector<int> watched(nireq, 0);
+    std::vector<bool> inFlight(nireq, false);
+
+    auto collectResults = [&](size_t r) {
+        WaitInfer(r, progress, watched[r], im);
+        inFlight[r] = false;
+
+        // Processing the inference result
+        std::map<std::string, std::list<DetectedObject>> detectedObjects = processResult(r, files[r]);
+
+        for (auto f : detectedObjects) {
+            for (auto o : f.second) {
+                dumper << f.first << o.objectType << o.ymin << o.xmin << o.ymax << o.xmax << o.prob;
+                dumper.endLine();
+            }
+        }
+
+        // Calculating similarity
+        //
+        for (size_t b = 0; b < files[r].size(); b++) {
+            ImageDescription result(detectedObjects[files[r][b]]);
+            im.apc.consumeImage(result, scaledDesiredForFiles.at(files[r][b]));
+        }
+    };
+
+    // images are decoded ahead in the order of the loop below
+    std::vector<std::string> imageFiles;
+    for (auto& ann : annCollector.annotations()) {
+        imageFiles.push_back(std::string(imagesPath) + "/" + ann.folder + "/" + (!subdir.empty() ? subdir + "/" : "") + ann.filename);
+    }
+    std::unique_ptr<ImagePrefetcher> prefetcher = StartDecoding(imageFiles, picInputName);
 
-    ImageDecoder decoder;
+    auto startTime = Clock::now();
+    size_t r = 0;
     while (iter != annCollector.annotations().end()) {
-        std::vector<std::string> files;
+        if (inFlight[r]) {
+            collectResults(r);
+        }
+
+        files[r].clear();
         size_t b = 0;
 
         int filesWatched = 0;
         for (; b < batch && iter != annCollector.annotations().end(); b++, iter++, filesWatched++) {
-            expected[b] = *iter;
             string filename = iter->folder + "/" + (!subdir.empty() ? subdir + "/" : "") + iter->filename;
             try {
-                Size orig_size = decoder.insertIntoBlob(std::string(imagesPath) + "/" + filename, b, firstInputBlob, preprocessingOptions);
+                Size orig_size = LoadImage(*prefetcher, b, r, picInputName, im);
                 float scale_x, scale_y;
 
                 scale_x = 1.0f / iter->size.width;  // orig_size.width;
                 scale_y = 1.0f / iter->size.height;  // orig_size.height;
 
                 if (scaleProposalToInputSize) {
-                    // looking for the channel axis
-                    if (firstInputBlob->_shape[1] == 3) {
-                        scale_x *= firstInputBlob->_shape[3];
-                        scale_y *= firstInputBlob->_shape[2];
-                    } else if (firstInputBlob->_shape[3] == 3) {
-                        scale_x *= firstInputBlob->_shape[2];
-                        scale_y *= firstInputBlob->_shape[1];
+                    // looking for the channel axis, bound blob has the size of the image if the backend resizes it
+                    const VShape &inputShape = backendPreprocessing ? inputDims : _backend->getBlob(picInput, r)->_shape;
+                    if (inputShape[1] == 3) {
+                        scale_x *= inputShape[3];
+                        scale_y *= inputShape[2];
+                    } else if (inputShape[3] == 3) {
+                        scale_x *= inputShape[2];
+                        scale_y *= inputShape[1];
                     }
                 }
 
                 // Scaling the desired result (taken from the annotation) to the network size
                 scaledDesiredForFiles.insert(std::pair<std::string, ImageDescription>(filename, desiredForFiles.at(filename).scale(scale_x, scale_y)));
 
-                files.push_back(filename);
+                files[r].push_back(filename);
             } catch (const std::exception& iex) {
                 slog::warn << "Can't read file " << this->imagesPath + "/" + filename << slog::endl;
                 slog::warn << "Error: " << iex.what() << slog::endl;
@@ -145,28 +190,21 @@ shared_ptr<Processor::InferenceMetrics> ObjectDetectionProcessor::Process(bool s
             }
         }
 
-        if (files.size() == batch) {
+        if (files[r].size() == batch) {
             // Infer model
-            Infer(progress, filesWatched, im);
-
-            // Processing the inference result
-            std::map<std::string, std::list<DetectedObject>> detectedObjects = processResult(files);
-
-            for (auto f : detectedObjects) {
-                for (auto o : f.second) {
-                    dumper << f.first << o.objectType << o.ymin << o.xmin << o.ymax << o.xmax << o.prob;
-                    dumper.endLine();
-                }
-            }
-
-            // Calculating similarity
-            //
-            for (size_t b = 0; b < files.size(); b++) {
-                ImageDescription result(detectedObjects[files[b]]);
-                im.apc.consumeImage(result, scaledDesiredForFiles.at(files[b]));
-            }
+            watched[r] = filesWatched;
+            StartInfer(r);
+            inFlight[r] = true;
+            r = (r + 1) % nireq;
+        }
+    }
+    // collect the rest of requests keeping the order they were started in
+    for (size_t i = 0; i < nireq; i++, r = (r + 1) % nireq) {
+        if (inFlight[r]) {
+            collectResults(r);
         }
     }
+    im.wallTime = std::chrono::duration_cast<std::chrono::duration<double, std::ratio<1, 1000>>>(Clock::now() - startTime).count();
     progress.finish();
 
     // -----------------------------------------------------------------------------------------------------
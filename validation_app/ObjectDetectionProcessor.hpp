@@ -39,11 +39,18 @@ protected:
 
     VShape inputDims;
     std::string picInputName;
+    TensorHandle picInput = INVALID_TENSOR_HANDLE;
 
-    virtual std::map<std::string, std::list<DetectedObject>> processResult(std::vector<std::string> files) = 0;
+    /**
+     * @brief Parses output blobs of the backend request
+     * @param request - index of backend request the inference was performed by
+     * @param files - names of images in the order they were put into the batch
+     */
+    virtual std::map<std::string, std::list<DetectedObject>> processResult(size_t request, std::vector<std::string> files) = 0;
 
 public:
     ObjectDetectionProcessor(Backend *backend, const std::string &flags_m, const std::vector<std::string> &outputs,
+                             const std::map<std::string, std::string> &config,
                              const std::string &flags_d, const std::string &flags_i, const std::string &subdir, int flags_b,
             double threshold,
             CsvDumper& dumper,
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <vector>
+
 enum class ResizeCropPolicy {
     DoNothing,
     Resize,
@@ -21,6 +23,13 @@ struct PreprocessingOptions {
     // the size before cropping
     size_t resizeBeforeCropX, resizeBeforeCropY;
 
+    // Mean and standard deviation of R, G and B channels, value of the channel is (pixel - mean) / deviation,
+    // pixel is scaled to 0..1 before if scaleValuesTo01 is set. Empty for the default of the input layout
+    std::vector<float> mean, deviation;
+
+    // JPEG images may be decoded reduced by scaled IDCT, not below the size they are resized to
+    bool scaledDecode = false;
+
     PreprocessingOptions() : scaleValuesTo01(false), resizeCropPolicy(ResizeCropPolicy::DoNothing), resizeBeforeCropX(0), resizeBeforeCropY(0) { }
 
     PreprocessingOptions(bool scaleValuesTo01, ResizeCropPolicy resizeCropPolicy, size_t resizeBeforeCropX = 0, size_t resizeBeforeCropY = 0)
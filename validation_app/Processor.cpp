@@ -4,6 +4,7 @@
 
 #include <string>
 #include <algorithm>
+#include <cstring>
 
 #include "user_exception.hpp"
 
@@ -11,24 +12,59 @@
 
 #include "Processor.hpp"
 
-Processor::Processor(Backend *backend, const std::string &flags_m, const std::vector<std::string> &outputs, const std::string &flags_d, const std::string &flags_i, int flags_b,
+Processor::Processor(Backend *backend, const std::string &flags_m, const std::vector<std::string> &outputs,
+        const std::map<std::string, std::string> &config, const std::string &flags_d, const std::string &flags_i, int flags_b,
         CsvDumper& dumper, const std::string& approach, PreprocessingOptions preprocessingOptions)
 
     : _backend(backend), modelFileName(flags_m), targetDevice(flags_d), imagesPath(flags_i), batch(flags_b),
       preprocessingOptions(preprocessingOptions), dumper(dumper), approach(approach) {
 
-    // Load model to plugin and create an inference request
-    std::map<std::string, std::string> config;
-    _backend->loadModel(flags_m, targetDevice, outputs, config);
+    // Load model to plugin and create inference requests, the time shows effect of compiled network caches
+    Clock::time_point loadStart = Clock::now();
+    if (!_backend->loadModel(flags_m, targetDevice, outputs, config)) {
+        THROW_USER_EXCEPTION(1) << "Cannot load model " << flags_m << " to " << targetDevice;
+    }
+    loadDuration = std::chrono::duration_cast<std::chrono::duration<double, std::ratio<1, 1000>>>(
+        Clock::now() - loadStart).count();
+    nireq = _backend->getRequestsNum();
+    requestStart.resize(nireq);
+    requestEnd.resize(nireq);
+    _backend->setCompletionCallback([this](size_t request, bool) {
+        std::lock_guard<std::mutex> lock(requestMutex);
+        requestEnd[request] = Clock::now();
+    });
+
     _inputInfo = _backend->getInputDataMap();
     _outputInfo = _backend->getOutputDataMap();
 
+    // backends may keep native precision of outputs or convert them, postprocessing reads float blobs
+    // and blobs quantized per tensor
+    for (auto &item : _outputInfo) {
+        const VBlob* output = _backend->getBlob(_backend->getTensorHandle(item.first), 0);
+        bool quantized = (output->_precision == U8 || output->_precision == I8) && output->_scale > 0.f;
+        if (output->_precision != FP32 && !quantized) {
+            THROW_USER_EXCEPTION(1) << "Output " << item.first << " is not FP32, the app cannot process it";
+        }
+    }
+
+    bool anyImageSize = false;
     for (auto &item : _inputInfo) {
         VShape inputDims = item.second._shape;
         if (inputDims.size() == 4) {
             batch = inputDims[0];
             slog::info << "Batch size is " << std::to_string(inputDims[0]) << slog::endl;
         }
+        anyImageSize = anyImageSize || item.second._anyImageSize;
+    }
+
+    // backend resizes the whole image as Resize policy does, crop and scaling of values are done by the app only
+    if (anyImageSize) {
+        backendPreprocessing = batch == 1 && !preprocessingOptions.scaleValuesTo01 &&
+                               preprocessingOptions.resizeCropPolicy == ResizeCropPolicy::Resize;
+        if (!backendPreprocessing) {
+            slog::warn << "Backend resizes only images of batch 1 with Resize preprocessing type, "
+                       << "images are preprocessed by the app" << slog::endl;
+        }
     }
 
 /*    if (batch == 0) {
@@ -50,17 +86,163 @@ Processor::Processor(Backend *backend, const std::string &flags_m, const std::ve
 */
 }
 
-double Processor::Infer(ConsoleProgress& progress, int filesWatched, InferenceMetrics& im) {
-    // Infer model
-    double time = getDurationOf([&]() {
-        bool result = _backend->infer();
-        if (!result) {
-            THROW_USER_EXCEPTION(1) << "Error happened during inference";
+void Processor::StartInfer(size_t request) {
+    {
+        std::lock_guard<std::mutex> lock(requestMutex);
+        requestStart[request] = Clock::now();
+    }
+    if (!_backend->startAsync(request)) {
+        THROW_USER_EXCEPTION(1) << "Cannot start inference";
+    }
+}
+
+Size Processor::LoadImage(ImageDecoder& decoder, const std::string& file, size_t batchPos, size_t request,
+                          const std::string& input, InferenceMetrics& im) {
+    Clock::time_point start = Clock::now();
+    Size size;
+    if (backendPreprocessing && _inputInfo.at(input)._anyImageSize) {
+        std::shared_ptr<VBlob> image = decoder.decodeImage(file);
+        if (!_backend->bindBlob(input, image, request)) {
+            THROW_USER_EXCEPTION(1) << "Cannot set image " << file << " to input " << input;
         }
-    });
+        size = Size(static_cast<int>(image->_shape[2]), static_cast<int>(image->_shape[1]));
+    } else {
+        size = decoder.insertIntoBlob(file, static_cast<int>(batchPos), _backend->getBlob(_backend->getTensorHandle(input), request),
+                                      *GetPreprocessingPlan(input));
+    }
+    im.decodeTime += std::chrono::duration_cast<std::chrono::duration<double, std::ratio<1, 1000>>>(
+        Clock::now() - start).count();
+    im.nImages++;
+    return size;
+}
+
+std::shared_ptr<PreprocessingPlan> Processor::GetPreprocessingPlan(const std::string& input) {
+    auto found = preprocessingPlans.find(input);
+    if (found != preprocessingPlans.end()) {
+        return found->second;
+    }
+    PreprocessingOptions options = preprocessingOptions;
+    if (_inputInfo.at(input)._anyImageSize) {
+        // backend normalizes images of the input even when the app resizes them
+        options.mean.clear();
+        options.deviation.clear();
+    }
+    std::shared_ptr<PreprocessingPlan> plan = std::make_shared<PreprocessingPlan>(
+        options, *_backend->getBlob(_backend->getTensorHandle(input), 0));
+    preprocessingPlans[input] = plan;
+    return plan;
+}
+
+/**
+ * Copies the dense image of batch 1 to the batch position of the blob having the same precision and layout
+ */
+static void copyImage(const VBlob& image, VBlob* blob, size_t batchPos) {
+    const size_t elementSize = getPrecisionSize(blob->_precision);
+    const VShape strides = blob->strides();
+    char* dst = static_cast<char*>(blob->_data) + batchPos * strides[0] * elementSize;
+    const char* src = static_cast<const char*>(image._data);
+    if (blob->_strides.empty() || strides == denseStrides(blob->_shape)) {
+        std::memcpy(dst, src, image.byteSize());
+        return;
+    }
+    // padded blob is filled element by element, image dimensions are walked as an odometer
+    const VShape& shape = image._shape;
+    VShape index(shape.size(), 0);
+    for (size_t n = 0, count = product(shape); n < count; n++) {
+        size_t offset = 0;
+        for (size_t d = 0; d < shape.size(); d++) {
+            offset += index[d] * strides[d];
+        }
+        std::memcpy(dst + offset * elementSize, src + n * elementSize, elementSize);
+        for (size_t d = shape.size(); d-- > 0 && ++index[d] == shape[d];) {
+            index[d] = 0;
+        }
+    }
+}
+
+std::unique_ptr<ImagePrefetcher> Processor::StartDecoding(const std::vector<std::string>& files, const std::string& input) {
+    // staging blobs are images of batch 1 in the format of the input, the input is read on this thread only.
+    // Decoding runs ahead of requests, so images are copied to the input once its request is idle
+    const VBlob* blob = _backend->getBlob(_backend->getTensorHandle(input), 0);
+    const std::shared_ptr<BlobAllocator> allocator = _backend->getAllocator();
+    VBlob prototype;
+    prototype._shape = blob->_shape;
+    prototype._shape[0] = 1;
+    prototype._precision = blob->_precision;
+    prototype._layout = blob->_layout;
+    prototype._colourFormat = blob->_colourFormat;
+    const bool bindImages = backendPreprocessing && _inputInfo.at(input)._anyImageSize;
+    const std::shared_ptr<PreprocessingPlan> plan = bindImages ? nullptr : GetPreprocessingPlan(input);
+
+    ImagePrefetcher::Decode decode = [prototype, allocator, bindImages, plan](ImageDecoder& decoder,
+                                                                              const std::string& file,
+                                                                              std::shared_ptr<VBlob>& image) -> Size {
+        if (bindImages) {
+            image = decoder.decodeImage(file);
+            return Size(static_cast<int>(image->_shape[2]), static_cast<int>(image->_shape[1]));
+        }
+        if (!image) {
+            image = std::make_shared<VBlob>(prototype);
+            image->allocate(image->byteSize(), allocator);
+        }
+        return decoder.insertIntoBlob(file, 0, image.get(), *plan);
+    };
+    return std::unique_ptr<ImagePrefetcher>(new ImagePrefetcher(files, decodeThreads, prefetchDepth * batch, decode));
+}
+
+Size Processor::LoadImage(ImagePrefetcher& prefetcher, size_t batchPos, size_t request, const std::string& input,
+                          InferenceMetrics& im) {
+    const ImagePrefetcher::Image& image = prefetcher.front();
+    Size size;
+    try {
+        if (!image.blob && !image.error) {
+            // nothing is decoded ahead without decode threads
+            size = LoadImage(imageDecoder, image.file, batchPos, request, input, im);
+        } else {
+            if (image.error) {
+                std::rethrow_exception(image.error);
+            }
+            Clock::time_point start = Clock::now();
+            if (backendPreprocessing && _inputInfo.at(input)._anyImageSize) {
+                if (!_backend->bindBlob(input, image.blob, request)) {
+                    THROW_USER_EXCEPTION(1) << "Cannot set image " << image.file << " to input " << input;
+                }
+            } else {
+                copyImage(*image.blob, _backend->getBlob(_backend->getTensorHandle(input), request), batchPos);
+            }
+            size = image.size;
+            im.decodeTime += image.decodeTime + std::chrono::duration_cast<std::chrono::duration<double, std::ratio<1, 1000>>>(
+                Clock::now() - start).count();
+            im.nImages++;
+        }
+    } catch (...) {
+        prefetcher.pop();
+        throw;
+    }
+    prefetcher.pop();
+    return size;
+}
+
+double Processor::WaitInfer(size_t request, ConsoleProgress& progress, int filesWatched, InferenceMetrics& im) {
+    bool result = _backend->wait(request);
+    if (!result) {
+        THROW_USER_EXCEPTION(1) << "Error happened during inference";
+    }
+
+    Clock::time_point start, end;
+    {
+        std::lock_guard<std::mutex> lock(requestMutex);
+        start = requestStart[request];
+        end = requestEnd[request];
+    }
+    // completion callback is called by backend's thread and might be not executed yet
+    if (end < start) {
+        end = Clock::now();
+    }
+    double time = std::chrono::duration_cast<std::chrono::duration<double, std::ratio<1, 1000>>>(end - start).count();
 
-    im.maxDuration = std::min(im.maxDuration, time);
-    im.minDuration = std::max(im.minDuration, time);
+    im.maxDuration = std::max(im.maxDuration, time);
+    im.minDuration = std::min(im.minDuration, time);
     im.totalTime += time;
     im.nRuns++;
 
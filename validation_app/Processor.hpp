@@ -8,11 +8,16 @@
 #include <limits>
 #include <string>
 #include <memory>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <chrono>
 
 #include <samples/common.hpp>
 
 #include "samples/csv_dumper.hpp"
 #include "image_decoder.hpp"
+#include "image_prefetcher.hpp"
 #include "samples/console_progress.hpp"
 #include "backend.hpp"
 
@@ -27,11 +32,18 @@ public:
         double minDuration = std::numeric_limits<double>::max();
         double maxDuration = 0;
         double totalTime = 0;
+        // time of the whole validation loop, with several requests in flight it is less than totalTime
+        double wallTime = 0;
+        // time of image decoding and preprocessing on the host, it is not included into inference time
+        double decodeTime = 0;
+        int nImages = 0;
 
         virtual ~InferenceMetrics() { }  // Type has to be polymorphic
     };
 
 protected:
+    typedef std::chrono::high_resolution_clock Clock;
+
     Backend* _backend;
     VInputInfo _inputInfo;
     VOutputInfo _outputInfo;
@@ -43,17 +55,90 @@ protected:
     size_t batch;
     double loadDuration;
     PreprocessingOptions preprocessingOptions;
+    // plans of image inputs, built from preprocessingOptions by the first image of the input
+    std::map<std::string, std::shared_ptr<PreprocessingPlan>> preprocessingPlans;
+    // images are resized by the backend for inputs supporting it
+    bool backendPreprocessing = false;
+    // images are decoded by these threads ahead of the inference, 0 decodes on the main thread
+    size_t decodeThreads = 1;
+    // batches decoded ahead
+    size_t prefetchDepth = 2;
+    // decodes images on the main thread, keeping its buffers between images
+    ImageDecoder imageDecoder;
 
     CsvDumper& dumper;
 
     std::string approach;
 
-    double Infer(ConsoleProgress& progress, int filesWatched, InferenceMetrics& im);
+    // number of backend requests kept in flight
+    size_t nireq;
+    std::vector<Clock::time_point> requestStart;
+    std::vector<Clock::time_point> requestEnd;
+    std::mutex requestMutex;
+
+    /**
+     * Starts asynchronous inference of the request, the request must not be in flight
+     */
+    void StartInfer(size_t request);
+    /**
+     * Waits for the request started by StartInfer and accounts its inference time
+     * @return inference time of the request in ms
+     */
+    double WaitInfer(size_t request, ConsoleProgress& progress, int filesWatched, InferenceMetrics& im);
+    /**
+     * Decodes the image into the input of the request at the batch position. Inputs resizing images themselves
+     * get the decoded image as is, others get it preprocessed by the app
+     * @return original image size
+     */
+    Size LoadImage(ImageDecoder& decoder, const std::string& file, size_t batchPos, size_t request,
+                   const std::string& input, InferenceMetrics& im);
+    /**
+     * @return preprocessing plan of the image input, built on the first call
+     */
+    std::shared_ptr<PreprocessingPlan> GetPreprocessingPlan(const std::string& input);
+    /**
+     * Starts decoding of the files for the input by decodeThreads, images are taken by LoadImage in the order of files
+     */
+    std::unique_ptr<ImagePrefetcher> StartDecoding(const std::vector<std::string>& files, const std::string& input);
+    /**
+     * Sets the next image of the prefetcher to the input of the request at the batch position. Errors of decoding
+     * are thrown here, as if the image was decoded by this call
+     * @return original image size
+     */
+    Size LoadImage(ImagePrefetcher& prefetcher, size_t batchPos, size_t request, const std::string& input,
+                   InferenceMetrics& im);
 
 public:
-    Processor(Backend *backend, const std::string &flags_m, const std::vector<std::string> &outputs, const std::string &flags_d, const std::string &flags_i, int flags_b,
+    Processor(Backend *backend, const std::string &flags_m, const std::vector<std::string> &outputs,
+            const std::map<std::string, std::string> &config, const std::string &flags_d, const std::string &flags_i, int flags_b,
             CsvDumper& dumper, const std::string& approach, PreprocessingOptions preprocessingOptions);
 
+    /**
+     * @param threads - number of threads decoding images ahead of the inference, 0 decodes on the main thread
+     * @param depth - number of batches decoded ahead
+     */
+    void SetDecoding(size_t threads, size_t depth) {
+        decodeThreads = threads;
+        prefetchDepth = std::max<size_t>(1, depth);
+    }
+
+    /**
+     * Sets mean and deviation of R, G and B channels images are normalized by, empty ones keep the defaults
+     * of the input format. Must be set before images are processed
+     */
+    void SetNormalization(const std::vector<float>& mean, const std::vector<float>& deviation) {
+        preprocessingOptions.mean = mean;
+        preprocessingOptions.deviation = deviation;
+    }
+
+    /**
+     * Allows JPEG images to be decoded reduced by scaled IDCT before they are resized. Must be set before images
+     * are processed
+     */
+    void SetScaledDecode(bool scaled) {
+        preprocessingOptions.scaledDecode = scaled;
+    }
+
     virtual shared_ptr<InferenceMetrics> Process(bool stream_output = false) = 0;
     virtual void Report(const InferenceMetrics& im) {
         double averageTime = im.totalTime / im.nRuns;
@@ -63,16 +148,42 @@ public:
         slog::info << "\tModel: " << modelFileName << "\n";
         slog::info << "\tBatch size: " << batch << "\n";
         slog::info << "\tValidation dataset: " << imagesPath << "\n";
-        slog::info << "\tValidation approach: " << approach;
+        slog::info << "\tValidation approach: " << approach << "\n";
+        slog::info << "\tInfer requests: " << nireq << "\n";
+        slog::info << "\tImage preprocessing: " << (backendPreprocessing ? "backend" : "application") << "\n";
+        if (decodeThreads > 0) {
+            slog::info << "\tImage decoding: " << decodeThreads << " threads, " << prefetchDepth << " batches ahead";
+        } else {
+            slog::info << "\tImage decoding: main thread";
+        }
+        if (preprocessingOptions.scaledDecode && JpegDecoder::isAvailable() && !backendPreprocessing &&
+            preprocessingOptions.resizeCropPolicy != ResizeCropPolicy::DoNothing) {
+            slog::info << ", JPEG images reduced by scaled IDCT";
+        }
         slog::info << slog::endl;
 
         if (im.nRuns > 0) {
             size_t batch = 1;
             slog::info << "Average infer time (ms): " << averageTime << " (" << OUTPUT_FLOATING(1000.0 / (averageTime / batch))
                     << " images per second with batch size = " << batch << ")" << slog::endl;
+            if (im.nImages > 0) {
+                slog::info << "Average image decoding and preprocessing time (ms): " << im.decodeTime / im.nImages
+                        << slog::endl;
+            }
+            if (nireq > 1 && im.wallTime > 0) {
+                slog::info << "Throughput with " << nireq << " infer requests: "
+                        << OUTPUT_FLOATING(1000.0 * im.nRuns * this->batch / im.wallTime) << " images per second" << slog::endl;
+            }
         } else {
             slog::warn << "No images processed" << slog::endl;
         }
+
+        Backend::InferenceMetrics backendMetrics;
+        backendMetrics.nRuns = im.nRuns;
+        backendMetrics.minDuration = im.minDuration;
+        backendMetrics.maxDuration = im.maxDuration;
+        backendMetrics.totalTime = im.totalTime;
+        _backend->report(backendMetrics);
     }
 
     virtual ~Processor() {}
@@ -19,14 +19,21 @@ using namespace std;
 
 class SSDObjectDetectionProcessor : public ObjectDetectionProcessor {
 protected:
-    std::map<std::string, std::list<DetectedObject>> processResult(std::vector<std::string> files) {
+    // output tensors are resolved once in constructor, processResult accesses them by handles
+    TensorHandle detectionOut = INVALID_TENSOR_HANDLE;
+    TensorHandle scoresOut = INVALID_TENSOR_HANDLE;
+    TensorHandle classesOut = INVALID_TENSOR_HANDLE;
+    TensorHandle boxesOut = INVALID_TENSOR_HANDLE;
+    // TFLite postprocessing numbers classes from 0
+    bool zeroBasedClasses = false;
+
+    std::map<std::string, std::list<DetectedObject>> processResult(size_t request, std::vector<std::string> files) {
         std::map<std::string, std::list<DetectedObject>> detectedObjects;
 
-        std::string firstOutputName = this->_outputInfo.begin()->first;
-        const auto detectionOutArray = _backend->getBlob(firstOutputName);
-        const float *box = static_cast<const float *>(detectionOutArray->_data);
-
         if (_outputInfo.size() == 1) {
+            const VBlob* detectionOutArray = _backend->getBlob(detectionOut, request);
+            const float *box = static_cast<const float *>(detectionOutArray->_data);
+
             VShape outputDims = _outputInfo.begin()->second._shape;
 
             const size_t maxProposalCount = outputDims[2];
@@ -55,49 +62,40 @@ protected:
                     DetectedObject(static_cast<int>(label), xmin, ymin, xmax, ymax, confidence));
             }
         } else if (_outputInfo.size() == 4) {
-            std::string scoresName = "Postprocessor/BatchMultiClassNonMaxSuppression_scores";
-            std::string classesName = "detection_classes:0";
-            std::string boxesName = "Postprocessor/BatchMultiClassNonMaxSuppression_boxes";
-            if (_outputInfo.find(scoresName) == _outputInfo.end() ||
-                _outputInfo.find(classesName) == _outputInfo.end() ||
-                _outputInfo.find(boxesName) == _outputInfo.end()) {
-                // TFLite
-                scoresName = "TFLite_Detection_PostProcess:2";
-                classesName = "TFLite_Detection_PostProcess:1";
-                boxesName = "TFLite_Detection_PostProcess";
-                if (_outputInfo.find(scoresName) == _outputInfo.end() ||
-                    _outputInfo.find(classesName) == _outputInfo.end() ||
-                    _outputInfo.find(boxesName) == _outputInfo.end()) {
-                    THROW_USER_EXCEPTION(1) << "We expect model converted by SNPE or TFLite with certain outputs, but cannot get them";
-                }
-            }
-
-            const auto scoresBlob = _backend->getBlob(scoresName);
-            const auto classesBlob = _backend->getBlob(classesName);
-            const auto boxesBlob = _backend->getBlob(boxesName);
+            const VBlob* scoresBlob = _backend->getBlob(scoresOut, request);
+            const VBlob* classesBlob = _backend->getBlob(classesOut, request);
+            const VBlob* boxesBlob = _backend->getBlob(boxesOut, request);
             const float *oScores = static_cast<const float *>(scoresBlob->_data);
             const float *oClasses = static_cast<const float *>(classesBlob->_data);
             const float *oBoxes = static_cast<const float *>(boxesBlob->_data);
 
-
-            for (size_t curProposal = 0; curProposal < scoresBlob->_shape[1]; curProposal++) {
-                float confidence = oScores[curProposal];
-                float label = static_cast<int>(oClasses[curProposal]);
-                if (classesName == "TFLite_Detection_PostProcess:1") {
-                 label += 1;
+            // scores and classes are [batch, proposals], boxes are [batch, proposals, 4]
+            const size_t proposalCount = scoresBlob->_shape[1];
+            for (size_t image_id = 0; image_id < files.size(); image_id++) {
+                const float *scores = oScores + image_id * proposalCount;
+                const float *classes = oClasses + image_id * proposalCount;
+                const float *boxes = oBoxes + image_id * proposalCount * 4;
+                // images without detections are accounted too
+                detectedObjects[files[image_id]];
+
+                for (size_t curProposal = 0; curProposal < proposalCount; curProposal++) {
+                    float confidence = scores[curProposal];
+                    float label = static_cast<int>(classes[curProposal]);
+                    if (zeroBasedClasses) {
+                     label += 1;
+                    }
+                    // boxes have follow layout top, left, bottom, right
+                    // according to this link: https://www.tensorflow.org/lite/models/object_detection/overview
+                    auto ymin = static_cast<int>(boxes[4 * curProposal] * inputDims[1]);
+                    auto xmin = static_cast<int>(boxes[4 * curProposal + 1] * inputDims[2]);
+                    auto ymax = static_cast<int>(boxes[4 * curProposal + 2] * inputDims[1]);
+                    auto xmax = static_cast<int>(boxes[4 * curProposal + 3] * inputDims[2]);
+
+                    if (ymin == 0.f && xmin == 0.f && ymax == 0.f && xmax == 0.f && confidence == 0.f)
+                        break;
+                    detectedObjects[files[image_id]].push_back(
+                        DetectedObject(static_cast<int>(label), xmin, ymin, xmax, ymax, confidence));
                 }
-                // boxes have follow layout top, left, bottom, right
-                // according to this link: https://www.tensorflow.org/lite/models/object_detection/overview
-                auto ymin = static_cast<int>(oBoxes[4 * curProposal] * inputDims[1]);
-                auto xmin = static_cast<int>(oBoxes[4 * curProposal + 1] * inputDims[2]);
-                auto ymax = static_cast<int>(oBoxes[4 * curProposal + 2] * inputDims[1]);
-                auto xmax = static_cast<int>(oBoxes[4 * curProposal + 3] * inputDims[2]);
-
-                if (ymin == 0.f && xmin == 0.f && ymax == 0.f && xmax == 0.f && confidence == 0.f)
-                    break;
-                size_t image_id = 0; // no support for batch so far
-                detectedObjects[files[static_cast<size_t>(image_id)]].push_back(
-                    DetectedObject(static_cast<int>(label), xmin, ymin, xmax, ymax, confidence));
             }
         } else {
             THROW_USER_EXCEPTION(1) << "This app accepts networks having only one output";
@@ -108,10 +106,36 @@ protected:
 
 public:
     SSDObjectDetectionProcessor(Backend *backend, const std::string &flags_m, const std::vector<std::string> &outputs,
+                                const std::map<std::string, std::string> &config,
                                 const std::string &flags_d, const std::string &flags_i, const std::string &subdir, int flags_b,
             double threshold, CsvDumper& dumper,
             const std::string& flags_a, const std::string& classes_list_file) :
 
-        ObjectDetectionProcessor(backend, flags_m, outputs, flags_d, flags_i, subdir, flags_b, threshold,
-                        dumper, flags_a, classes_list_file, PreprocessingOptions(false, ResizeCropPolicy::Resize), true) { }
+        ObjectDetectionProcessor(backend, flags_m, outputs, config, flags_d, flags_i, subdir, flags_b, threshold,
+                        dumper, flags_a, classes_list_file, PreprocessingOptions(false, ResizeCropPolicy::Resize), true) {
+        if (_outputInfo.size() == 1) {
+            detectionOut = _backend->getTensorHandle(_outputInfo.begin()->first);
+        } else if (_outputInfo.size() == 4) {
+            std::string scoresName = "Postprocessor/BatchMultiClassNonMaxSuppression_scores";
+            std::string classesName = "detection_classes:0";
+            std::string boxesName = "Postprocessor/BatchMultiClassNonMaxSuppression_boxes";
+            if (_outputInfo.find(scoresName) == _outputInfo.end() ||
+                _outputInfo.find(classesName) == _outputInfo.end() ||
+                _outputInfo.find(boxesName) == _outputInfo.end()) {
+                // TFLite
+                scoresName = "TFLite_Detection_PostProcess:2";
+                classesName = "TFLite_Detection_PostProcess:1";
+                boxesName = "TFLite_Detection_PostProcess";
+                if (_outputInfo.find(scoresName) == _outputInfo.end() ||
+                    _outputInfo.find(classesName) == _outputInfo.end() ||
+                    _outputInfo.find(boxesName) == _outputInfo.end()) {
+                    THROW_USER_EXCEPTION(1) << "We expect model converted by SNPE or TFLite with certain outputs, but cannot get them";
+                }
+            }
+            scoresOut = _backend->getTensorHandle(scoresName);
+            classesOut = _backend->getTensorHandle(classesName);
+            boxesOut = _backend->getTensorHandle(boxesName);
+            zeroBasedClasses = classesName == "TFLite_Detection_PostProcess:1";
+        }
+    }
 };
@@ -94,11 +94,12 @@ private:
     }
 
 protected:
-    std::map<std::string, std::list<DetectedObject>> processResult(std::vector<std::string> files) {
+    TensorHandle firstOutput;
+
+    std::map<std::string, std::list<DetectedObject>> processResult(size_t request, std::vector<std::string> files) {
         std::map<std::string, std::list<DetectedObject>> detectedObjects;
 
-        std::string firstOutputName = this->_outputInfo.begin()->first;
-        const auto detectionOutArray = _backend->getBlob(firstOutputName);
+        const VBlob* detectionOutArray = _backend->getBlob(firstOutput, request);
         const float *box = static_cast<float*>(detectionOutArray->_data);
 
         std::string file = *files.begin();
@@ -112,10 +113,13 @@ protected:
 
 public:
     YOLOObjectDetectionProcessor(Backend *backend, const std::string &flags_m, const std::vector<std::string> &outputs,
+                                 const std::map<std::string, std::string> &config,
                                  const std::string &flags_d, const std::string &flags_i, const std::string &subdir, int flags_b,
             double threshold, CsvDumper& dumper,
             const std::string& flags_a, const std::string& classes_list_file) :
 
-        ObjectDetectionProcessor(backend, flags_m, outputs, flags_d, flags_i, subdir, flags_b, threshold,
-                        dumper, flags_a, classes_list_file, PreprocessingOptions(true, ResizeCropPolicy::Resize), false) { }
+        ObjectDetectionProcessor(backend, flags_m, outputs, config, flags_d, flags_i, subdir, flags_b, threshold,
+                        dumper, flags_a, classes_list_file, PreprocessingOptions(true, ResizeCropPolicy::Resize), false) {
+        firstOutput = _backend->getTensorHandle(_outputInfo.begin()->first);
+    }
 };
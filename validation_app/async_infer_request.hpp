@@ -0,0 +1,152 @@
+// Copyright 2021 the dldt tools authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/**
+ * Pins the calling thread to the cores [firstCore, firstCore + cores), cores are taken round robin if they exceed
+ * their number. Threads the caller creates afterwards, e.g. thread pools of a runtime, inherit the cores
+ * @return false if pinning is not supported or failed
+ */
+inline bool pinCurrentThread(size_t firstCore, size_t cores) {
+#if defined(__linux__)
+    size_t ncores = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (size_t c = 0; c < std::max<size_t>(1, std::min(cores, ncores)); c++) {
+        CPU_SET((firstCore + c) % ncores, &mask);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Pins the calling thread to the core, cores are taken round robin if core exceeds their number
+ * @return false if pinning is not supported or failed
+ */
+inline bool pinCurrentThread(size_t core) {
+    return pinCurrentThread(core, 1);
+}
+
+/**
+ * Gives start/wait/callback semantic to a blocking inference routine for the backends
+ * which do not have native asynchronous API. Every object owns one worker thread
+ */
+class AsyncInferRequest {
+public:
+    typedef std::function<bool()> Task;
+    typedef std::function<void(bool status)> Callback;
+    typedef std::function<void()> Init;
+
+    /**
+     * @param init - executed once in the worker thread before any task, e.g. to pin the thread
+     *               or to configure thread local state of the runtime
+     */
+    explicit AsyncInferRequest(Task task, Init init = nullptr) : _task(task), _init(init) {
+        _worker = std::thread([this]() { run(); });
+    }
+
+    ~AsyncInferRequest() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cv.notify_all();
+        _worker.join();
+    }
+
+    AsyncInferRequest(const AsyncInferRequest &) = delete;
+    AsyncInferRequest &operator=(const AsyncInferRequest &) = delete;
+
+    /**
+     * schedules task execution, returns false if previous execution has not been waited yet
+     */
+    bool start(Callback callback = nullptr) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_busy) {
+                return false;
+            }
+            _busy = true;
+            _callback = callback;
+        }
+        _cv.notify_all();
+        return true;
+    }
+
+    /**
+     * blocks until the scheduled execution is finished, returns the task result.
+     * Returns true immediately if nothing was scheduled
+     */
+    bool wait() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [this]() { return !_busy; });
+        return _status;
+    }
+
+private:
+    void run() {
+        if (_init) {
+            try {
+                _init();
+            } catch (...) {
+                // configuration of the thread is best effort, tasks still can be executed
+            }
+        }
+        for (;;) {
+            Callback callback;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cv.wait(lock, [this]() { return _stop || (_busy && !_running); });
+                if (_stop) {
+                    return;
+                }
+                _running = true;
+                callback = _callback;
+            }
+
+            bool status = false;
+            try {
+                status = _task();
+            } catch (...) {
+                // any exception escaping the worker would terminate the app, the request fails instead
+                status = false;
+            }
+            if (callback) {
+                callback(status);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _status = status;
+                _running = false;
+                _busy = false;
+            }
+            _cv.notify_all();
+        }
+    }
+
+    Task _task;
+    Init _init;
+    Callback _callback;
+    std::thread _worker;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _busy = false;
+    bool _running = false;
+    bool _stop = false;
+    bool _status = true;
+};
@@ -8,6 +8,16 @@
 #include <map>
 #include <vector>
 #include <numeric>
+#include <functional>
+#include <sstream>
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+
+#include "blob_allocator.hpp"
 
 // #include "inference_engine.hpp"
 
@@ -32,32 +42,280 @@ enum evPrecision : uint8_t {
     CUSTOM = 80        /**< custom precision has it's own name and size of elements */
 };
 
+enum evLayout : uint8_t {
+    NCHW = 0,          /**< planar, channels are outer to spatial dimensions */
+    NHWC = 1           /**< interleaved, channels are the innermost dimension */
+};
+
+enum evColourFormat : uint8_t {
+    BGR = 0,           /**< OpenCV order of channels */
+    RGB = 1
+};
+
+/**
+ * @return size of one element of the precision in bytes, 0 for precisions having no fixed byte size
+ */
+inline size_t getPrecisionSize(evPrecision precision) noexcept {
+    switch (precision) {
+    case FP32:
+    case I32:
+        return 4;
+    case FP16:
+    case BF16:
+    case Q78:
+    case I16:
+    case U16:
+        return 2;
+    case U8:
+    case I8:
+    case BOOL:
+        return 1;
+    case I64:
+    case U64:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Keys of the configuration map passed to Backend::loadModel which are understood by every backend.
+ * Keys unknown to a backend are either passed to the underlying runtime or ignored
+ */
+namespace BackendConfig {
+/// Number of independent inference requests the backend creates. "0" or absent key lets the backend choose the
+/// optimal number for the device, backends which cannot tell it create one request
+static const char REQUESTS_NUM[] = "REQUESTS_NUM";
+/// Number of threads one inference uses, "0" keeps the backend default
+static const char INFERENCE_THREADS[] = "INFERENCE_THREADS";
+/// Number of streams executing requests in parallel for backends having native streams, "0" keeps the default
+static const char STREAMS[] = "STREAMS";
+/// Pinning of inference threads to cores, "YES" or "NO" (default)
+static const char CPU_BIND[] = "CPU_BIND";
+/// Performance profile, one of the PROFILE_ values below. Backends map it to their closest native mode
+static const char PERFORMANCE_PROFILE[] = "PERFORMANCE_PROFILE";
+/// Collection of per-layer execution time, "YES" or "NO" (default). Might slow down inference
+static const char PROFILING[] = "PROFILING";
+/// Batch of image (4D) inputs, "0" or absent key keeps the batch of the model. Backends which cannot reshape
+/// the model ignore it
+static const char BATCH[] = "BATCH";
+/// Resizing of images by the backend itself, "YES" or "NO" (default). Inputs the backend can do it for are
+/// marked by IOInfo::_anyImageSize
+static const char PREPROCESSING[] = "PREPROCESSING";
+/// Mean and deviation of R, G and B channels as "R,G,B" the backend normalizes pixels by when it preprocesses
+/// images itself (PREPROCESSING). Set by -ppMean and -ppStd, inputs preprocessed by the app ignore them
+static const char MEAN_VALUES[] = "MEAN_VALUES";
+static const char STD_VALUES[] = "STD_VALUES";
+
+static const char YES[] = "YES";
+static const char NO[] = "NO";
+static const char PROFILE_LATENCY[] = "LATENCY";
+static const char PROFILE_THROUGHPUT[] = "THROUGHPUT";
+static const char PROFILE_BALANCED[] = "BALANCED";
+static const char PROFILE_POWER_SAVER[] = "POWER_SAVER";
+
+/// @return true for keys of the common vocabulary above
+inline bool isCommonKey(const std::string &key) {
+    return key == REQUESTS_NUM || key == INFERENCE_THREADS || key == STREAMS || key == CPU_BIND ||
+           key == PERFORMANCE_PROFILE || key == PROFILING || key == PREPROCESSING ||
+           key == MEAN_VALUES || key == STD_VALUES || key == BATCH;
+}
+}
+
+/**
+ * Returns value of the config key converted to the type of the default value,
+ * default value is returned if the key is absent or cannot be converted
+ */
+template <typename T>
+inline T getConfigValue(const std::map<std::string, std::string> &config, const std::string &key, T defaultValue) {
+    auto it = config.find(key);
+    if (it == config.end()) {
+        return defaultValue;
+    }
+    T value;
+    std::istringstream stream(it->second);
+    if (!(stream >> value)) {
+        return defaultValue;
+    }
+    return value;
+}
+
+/**
+ * Returns values of R, G and B channels the config key gives as "R,G,B",
+ * empty vector is returned if the key is absent or has not 3 numbers
+ */
+inline std::vector<float> getChannelValues(const std::map<std::string, std::string> &config, const std::string &key) {
+    std::vector<float> values;
+    auto it = config.find(key);
+    if (it == config.end()) {
+        return values;
+    }
+    std::istringstream stream(it->second);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        std::istringstream itemStream(item);
+        float value;
+        if (!(itemStream >> value)) {
+            return std::vector<float>();
+        }
+        values.push_back(value);
+    }
+    if (values.size() != 3) {
+        values.clear();
+    }
+    return values;
+}
+
 typedef std::vector<size_t> VShape;
 struct IOInfo {
     VShape _shape;
     evPrecision _precision = UNSPECIFIED;
+    // input takes U8 BGR image of NHWC layout and any size through bindBlob, resize and normalization by
+    // BackendConfig::MEAN_VALUES and STD_VALUES are done by the backend
+    bool _anyImageSize = false;
 };
 
 typedef std::map<std::string, IOInfo> VInputInfo;
 typedef std::map<std::string, IOInfo> VOutputInfo;
 
+/**
+ * Index of input or output tensor resolved once after loadModel, the same for all requests and replicas
+ */
+typedef size_t TensorHandle;
+static const TensorHandle INVALID_TENSOR_HANDLE = static_cast<TensorHandle>(-1);
+
 inline size_t product(const VShape &dims) noexcept {
     if (dims.empty()) return 0;
     return std::accumulate(std::begin(dims), std::end(dims), (size_t)1, std::multiplies<size_t>());
 }
 
+/**
+ * Execution statistics of one layer (operator) aggregated over all inferences of all requests
+ */
+struct LayerProfile {
+    std::string _name;
+    std::string _type;
+    double _totalTime = 0;  // ms
+    size_t _count = 0;      // number of executions
+};
+
+typedef std::vector<LayerProfile> VProfile;
+
+/**
+ * Accumulates one execution of the layer into the profile kept by name
+ */
+inline void addLayerTime(std::map<std::string, LayerProfile> &profile, const std::string &name, const std::string &type,
+                         double time) {
+    LayerProfile &layer = profile[name];
+    layer._name = name;
+    layer._type = type;
+    layer._totalTime += time;
+    layer._count++;
+}
+
+/**
+ * Merges per-request profiles and sorts layers by total time, the hottest layer first
+ */
+inline VProfile mergeProfiles(const std::vector<const std::map<std::string, LayerProfile>*> &profiles) {
+    std::map<std::string, LayerProfile> merged;
+    for (auto profile : profiles) {
+        for (auto &item : *profile) {
+            LayerProfile &layer = merged[item.first];
+            layer._name = item.second._name;
+            layer._type = item.second._type;
+            layer._totalTime += item.second._totalTime;
+            layer._count += item.second._count;
+        }
+    }
+    VProfile result;
+    for (auto &item : merged) {
+        result.push_back(item.second);
+    }
+    std::sort(result.begin(), result.end(), [](const LayerProfile &l, const LayerProfile &r) {
+        return l._totalTime > r._totalTime;
+    });
+    return result;
+}
+
+/**
+ * Prints hotspot table of the profile, layers are expected to be sorted by mergeProfiles
+ */
+inline void printProfile(std::ostream &out, const VProfile &profile) {
+    std::ios format(nullptr);
+    format.copyfmt(out);
+    double total = 0;
+    for (auto &layer : profile) {
+        total += layer._totalTime;
+    }
+    out << "Per-layer profile (" << profile.size() << " layers, " << std::fixed << std::setprecision(3) << total
+        << " ms in total):" << std::endl;
+    out << std::left << std::setw(48) << "Layer" << std::setw(24) << "Type" << std::right << std::setw(10) << "Count"
+        << std::setw(14) << "Avg (ms)" << std::setw(14) << "Total (ms)" << std::setw(9) << "%" << std::endl;
+    for (auto &layer : profile) {
+        std::string name = layer._name.size() > 47 ? layer._name.substr(0, 44) + "..." : layer._name;
+        std::string type = layer._type.size() > 23 ? layer._type.substr(0, 20) + "..." : layer._type;
+        out << std::left << std::setw(48) << name << std::setw(24) << type << std::right << std::setw(10) << layer._count
+            << std::setw(14) << (layer._count ? layer._totalTime / layer._count : 0.) << std::setw(14) << layer._totalTime
+            << std::setw(8) << std::setprecision(2) << (total > 0 ? 100. * layer._totalTime / total : 0.) << "%"
+            << std::setprecision(3) << std::endl;
+    }
+    out.copyfmt(format);
+}
+
+/**
+ * @return strides in elements of dense tensor having the shape
+ */
+inline VShape denseStrides(const VShape &dims) {
+    VShape strides(dims.size(), 1);
+    for (size_t i = dims.size(); i > 1; i--) {
+        strides[i - 2] = strides[i - 1] * dims[i - 1];
+    }
+    return strides;
+}
+
+/**
+ * Memory ownership contract: _memory holds the memory _data points to if the blob owns it (allocate()).
+ * Blob with empty _memory borrows memory (borrow()) of a backend tensor or of the caller,
+ * the lender guarantees the memory is valid while the blob is in use.
+ * Owned memory is BLOB_ALIGNMENT aligned and returned to the allocator it was taken from
+ */
 struct VBlob {
     VShape _shape;
+    // in elements, empty for dense tensor
+    VShape _strides;
     void* _data = nullptr;
+    std::shared_ptr<void> _memory;
     evPrecision _precision = FP32;
-    bool _ownMemory = true;
-    std::string _layout = "NCHW"; // NCHW/NHWC
-    std::string _colourFormat = "BGR"; // BGR /RGB
+    evLayout _layout = NCHW;
+    evColourFormat _colourFormat = BGR;
+    // U8/I8 blob quantized per tensor holds q, real value is (q - _zeroPoint) * _scale. 0 scale for other blobs
+    float _scale = 0.f;
+    int32_t _zeroPoint = 0;
 
-    ~VBlob() {
-        if (_ownMemory) {
-            free(_data);
+    VShape strides() const {
+        return _strides.empty() ? denseStrides(_shape) : _strides;
+    }
+
+    size_t byteSize() const {
+        return product(_shape) * getPrecisionSize(_precision);
+    }
+
+    void allocate(size_t bytes, std::shared_ptr<BlobAllocator> allocator = getDefaultAllocator()) {
+        void *ptr = allocator->allocate(bytes, BLOB_ALIGNMENT);
+        if (!ptr) {
+            throw std::bad_alloc();
         }
+        _memory.reset(ptr, [allocator](void *p) { allocator->deallocate(p); });
+        _data = _memory.get();
+    }
+
+    void borrow(void *data) {
+        _memory.reset();
+        _data = data;
+    }
+
+    bool ownsMemory() const {
+        return _memory != nullptr;
     }
 };
 
@@ -72,6 +330,13 @@ public:
         virtual ~InferenceMetrics() { }  // Type has to be polymorphic
     };
 
+    /**
+     * Called by backend from its own thread once asynchronous request is finished
+     * @param request - index of finished request
+     * @param status - true if inference succeeded
+     */
+    typedef std::function<void(size_t request, bool status)> CompletionCallback;
+
     /**
      * TODO(amalyshe) add more extended error handling mechanism instead of just bool
      */
@@ -82,18 +347,87 @@ public:
      * TODO(amalyshe) need to remove export of shared_ptr between interfaces
      */
     virtual std::shared_ptr<InferenceMetrics> process(bool streamOutput = false) = 0;
+    /**
+     * Prints backend specific part of the report, per-layer hotspot table if profiling is enabled
+     */
     virtual void report(const InferenceMetrics &im) const = 0;
+    /**
+     * @return per-layer statistics aggregated over all inferences since loadModel, sorted by total time.
+     * Empty if BackendConfig::PROFILING is not enabled or backend cannot collect it.
+     * Must not be called while requests are in flight
+     */
+    virtual VProfile getProfile() const = 0;
     virtual bool infer() = 0;
 
+    /**
+     * Asynchronous API. During loadModel backend creates BackendConfig::REQUESTS_NUM independent requests,
+     * each of them has own input and output blobs. Request 0 is the one used by blocking infer() and getBlob(name).
+     * Only one inference can be in flight per request, blobs of the request must not be touched until wait() returns
+     */
+    virtual size_t getRequestsNum() const = 0;
+    virtual bool startAsync(size_t request) = 0;
+    /**
+     * blocks until the request started by startAsync is finished, returns status of inference
+     */
+    virtual bool wait(size_t request) = 0;
+    /**
+     * callback is shared by all requests and must be set before the first startAsync
+     */
+    virtual void setCompletionCallback(CompletionCallback callback) = 0;
+
     virtual std::shared_ptr<VBlob> getBlob(const std::string &name) = 0;
+    virtual std::shared_ptr<VBlob> getBlob(const std::string &name, size_t request) = 0;
+
+    /**
+     * Handle based access for the inference loop, no string lookup, allocation or reference counting.
+     * getTensorHandle returns INVALID_TENSOR_HANDLE for unknown name. getBlob does not check arguments,
+     * handle must be valid and request less than getRequestsNum(), returned pointer lives until the tensor is rebound
+     */
+    virtual TensorHandle getTensorHandle(const std::string &name) const = 0;
+    virtual VBlob* getBlob(TensorHandle handle, size_t request) = 0;
+
+    /**
+     * Zero-copy binding. Makes the request read the input or write the output directly in the memory of the blob,
+     * after that getBlob returns this blob. The blob must have shape and precision of the tensor and the memory
+     * must stay valid while it is bound, backend holds reference to the blob but not necessarily to its memory.
+     * Blobs returned by getBlob without binding already borrow backend tensor memory where backend allows it
+     * @return false if backend cannot use external memory for the tensor, previous blob is kept in this case
+     */
+    virtual bool bindBlob(const std::string &name, std::shared_ptr<VBlob> blob, size_t request) = 0;
+
+    /**
+     * Creates one more backend object which shares the model loaded by this one (compiled network, weights)
+     * but has own inference requests and blobs, so replicas can be inferred concurrently from different threads.
+     * Must be called after successful loadModel, replica must be destroyed by release()
+     * @return nullptr if replica cannot be created
+     */
+    virtual Backend* createReplica() = 0;
+
+    /**
+     * Sets allocator for blob memory owned by the backend. Must be called before loadModel,
+     * replicas inherit allocator of the original backend
+     */
+    virtual void setAllocator(std::shared_ptr<BlobAllocator> allocator) {
+        _allocator = allocator ? allocator : getDefaultAllocator();
+    }
+
+    /**
+     * @return allocator of blob memory owned by the backend, the app allocates its host blobs by it too
+     */
+    std::shared_ptr<BlobAllocator> getAllocator() const {
+        return _allocator;
+    }
 
     /**
      * deteltes current object. required to avoid collisions between different C++ libraries if ever
      */
     virtual void release() = 0;
 
-    virtual VInputInfo getInputDataMap() const = 0;
-    virtual VOutputInfo getOutputDataMap() const = 0;
+    virtual const VInputInfo& getInputDataMap() const = 0;
+    virtual const VOutputInfo& getOutputDataMap() const = 0;
 
     virtual ~Backend() { }
+
+protected:
+    std::shared_ptr<BlobAllocator> _allocator = getDefaultAllocator();
 };
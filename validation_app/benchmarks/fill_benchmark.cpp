@@ -0,0 +1,185 @@
+// Copyright 2021 the dldt tools authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+
+/**
+ * Microbenchmark of blob filling from a decoded image. Reference loops are the ones ImageDecoder used before
+ * PixelConverter: element by element conversion followed by passes of normalization and channel swap. Every
+ * case prints time per image of the reference and of PixelConverter with every instruction set of the CPU,
+ * and the maximum difference of values from the reference.
+ * Usage: fill_benchmark [size [iterations]], 224 and 200 by default
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../fill_kernels.hpp"
+
+typedef std::chrono::high_resolution_clock Clock;
+
+struct Image {
+    size_t width;
+    size_t height;
+    std::vector<uint8_t> pixels;  // BGR, interleaved
+
+    const uint8_t *at(size_t h, size_t w) const {
+        return pixels.data() + (h * width + w) * 3;
+    }
+};
+
+static void referencePlanar(const Image &image, float *blob, bool rgb) {
+    const size_t plane = image.width * image.height;
+    for (size_t c = 0; c < 3; c++) {
+        for (size_t h = 0; h < image.height; h++) {
+            for (size_t w = 0; w < image.width; w++) {
+                blob[c * plane + h * image.width + w] = static_cast<float>(image.at(h, w)[c]);
+            }
+        }
+    }
+    if (rgb) {
+        const float sub[3] = { 103.5f, 116.3f, 123.6f };
+        const float div[3] = { 57.375f, 57.12f, 58.395f };
+        for (size_t c = 0; c < 3; c++) {
+            for (size_t i = 0; i < plane; i++) {
+                blob[c * plane + i] = (blob[c * plane + i] - sub[c]) / div[c];
+            }
+        }
+        for (size_t i = 0; i < plane; i++) {
+            std::swap(blob[i], blob[2 * plane + i]);
+        }
+    }
+}
+
+static void referenceInterleaved(const Image &image, float *blob, bool rgb) {
+    for (size_t h = 0; h < image.height; h++) {
+        for (size_t w = 0; w < image.width; w++) {
+            for (size_t c = 0; c < 3; c++) {
+                blob[(h * image.width + w) * 3 + c] = (static_cast<float>(image.at(h, w)[c]) - 128.f) / 127.f;
+            }
+        }
+    }
+    if (rgb) {
+        for (size_t i = 0; i < image.width * image.height; i++) {
+            std::swap(blob[3 * i], blob[3 * i + 2]);
+        }
+    }
+}
+
+static void referenceInterleavedU8(const Image &image, uint8_t *blob) {
+    for (size_t h = 0; h < image.height; h++) {
+        for (size_t w = 0; w < image.width; w++) {
+            size_t i = (h * image.width + w) * 3;
+            blob[i] = image.at(h, w)[2];
+            blob[i + 1] = image.at(h, w)[1];
+            blob[i + 2] = image.at(h, w)[0];
+        }
+    }
+}
+
+// the same transforms ImageDecoder builds for the blobs
+static PixelTransform planarTransform(bool rgb) {
+    PixelTransform t;
+    const float sub[3] = { 103.5f, 116.3f, 123.6f };
+    const float div[3] = { 57.375f, 57.12f, 58.395f };
+    for (int d = 0; d < 3; d++) {
+        if (rgb) {
+            int c = 2 - d;
+            t.order[d] = c;
+            t.scale[d] = 1.f / div[c];
+            t.shift[d] = -sub[c] / div[c];
+        }
+    }
+    return t;
+}
+
+static PixelTransform interleavedTransform(bool rgb, bool normalize) {
+    PixelTransform t;
+    for (int d = 0; d < 3; d++) {
+        t.order[d] = rgb ? 2 - d : d;
+        if (normalize) {
+            t.scale[d] = 1.f / 127.f;
+            t.shift[d] = -128.f / 127.f;
+        }
+    }
+    return t;
+}
+
+static double measure(size_t iterations, const std::function<void()> &fill) {
+    fill();  // warm up
+    auto start = Clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        fill();
+    }
+    return std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(Clock::now() - start).count() / iterations;
+}
+
+template <class T>
+static double maxDifference(const std::vector<T> &a, const std::vector<T> &b) {
+    double diff = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        diff = std::max(diff, std::fabs(static_cast<double>(a[i]) - static_cast<double>(b[i])));
+    }
+    return diff;
+}
+
+template <class T>
+static void run(const std::string &name, const Image &image, size_t iterations, bool planar,
+                const PixelTransform &transform, const std::function<void(T*)> &reference) {
+    const size_t size = image.width * image.height * 3;
+    std::vector<T> expected(size), actual(size);
+    double referenceTime = measure(iterations, [&]() { reference(expected.data()); });
+    std::cout << std::left << std::setw(22) << name << std::setw(10) << "reference" << std::right << std::fixed
+              << std::setprecision(1) << std::setw(9) << referenceTime << " us" << std::endl;
+
+    PixelConverter converter(transform);
+    const size_t wStride = planar ? 1 : 3;
+    const size_t cStride = planar ? image.width * image.height : 1;
+    const size_t hStride = planar ? image.width : image.width * 3;
+    for (int isa = 0; isa <= static_cast<int>(detectFillIsa()); isa++) {
+        setFillIsa(static_cast<FillIsa>(isa));
+        double time = measure(iterations, [&]() {
+            for (size_t h = 0; h < image.height; h++) {
+                converter.convert(image.at(h, 0), image.width, actual.data() + h * hStride, wStride, cStride);
+            }
+        });
+        std::cout << std::left << std::setw(22) << "" << std::setw(10) << fillIsaName(static_cast<FillIsa>(isa))
+                  << std::right << std::setw(9) << time << " us  x" << std::setprecision(2) << referenceTime / time
+                  << "  max diff " << std::scientific << maxDifference(expected, actual) << std::fixed
+                  << std::setprecision(1) << std::endl;
+    }
+    setFillIsa(detectFillIsa());
+}
+
+int main(int argc, char *argv[]) {
+    const size_t size = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 224;
+    const size_t iterations = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200;
+    if (size == 0 || iterations == 0) {
+        std::cerr << "Usage: fill_benchmark [size [iterations]]" << std::endl;
+        return 1;
+    }
+
+    Image image{ size, size, std::vector<uint8_t>(size * size * 3) };
+    std::mt19937 random(0);
+    for (auto &p : image.pixels) {
+        p = static_cast<uint8_t>(random());
+    }
+
+    std::cout << "Image " << size << "x" << size << ", time per image, widest instruction set is "
+              << fillIsaName(detectFillIsa()) << std::endl;
+    run<float>("NCHW FP32 BGR", image, iterations, true, planarTransform(false),
+               [&](float *blob) { referencePlanar(image, blob, false); });
+    run<float>("NCHW FP32 RGB mean", image, iterations, true, planarTransform(true),
+               [&](float *blob) { referencePlanar(image, blob, true); });
+    run<float>("NHWC FP32 RGB", image, iterations, false, interleavedTransform(true, true),
+               [&](float *blob) { referenceInterleaved(image, blob, true); });
+    run<uint8_t>("NHWC U8 RGB", image, iterations, false, interleavedTransform(true, false),
+                 [&](uint8_t *blob) { referenceInterleavedU8(image, blob); });
+    return 0;
+}
@@ -0,0 +1,80 @@
+// Copyright 2021 the dldt tools authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+/// alignment of blob memory allocated by the app and backends, enough for any SIMD load and a cache line
+static const size_t BLOB_ALIGNMENT = 64;
+
+/**
+ * Allocator hook for blob memory. Backends and the app allocate blobs through it, so all of them
+ * can be drawn from a shared arena or pool by setting custom allocator to the backend.
+ * Decoding threads of the app allocate concurrently, so the allocator must be thread safe
+ */
+class BlobAllocator {
+public:
+    /**
+     * @return memory of at least bytes size aligned at least to alignment, nullptr on failure
+     */
+    virtual void* allocate(size_t bytes, size_t alignment) = 0;
+    virtual void deallocate(void *ptr) = 0;
+    virtual ~BlobAllocator() { }
+};
+
+/**
+ * Default allocator, aligned heap memory. If huge pages are requested, big buffers are aligned to huge page
+ * and advised to be backed by transparent huge pages to reduce TLB misses on large tensors
+ */
+class AlignedAllocator : public BlobAllocator {
+public:
+    explicit AlignedAllocator(bool hugePages = false) : _hugePages(hugePages) { }
+
+    void* allocate(size_t bytes, size_t alignment) override {
+        bool huge = _hugePages && bytes >= HUGE_PAGE_SIZE;
+        if (huge) {
+            alignment = HUGE_PAGE_SIZE;
+        }
+        if (alignment < sizeof(void*)) {
+            alignment = sizeof(void*);
+        }
+        void *ptr = nullptr;
+#if defined(_WIN32)
+        ptr = _aligned_malloc(bytes, alignment);
+#else
+        if (posix_memalign(&ptr, alignment, bytes) != 0) {
+            return nullptr;
+        }
+#endif
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        if (huge) {
+            madvise(ptr, bytes, MADV_HUGEPAGE);
+        }
+#endif
+        return ptr;
+    }
+
+    void deallocate(void *ptr) override {
+#if defined(_WIN32)
+        _aligned_free(ptr);
+#else
+        free(ptr);
+#endif
+    }
+
+private:
+    static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+    bool _hugePages;
+};
+
+inline std::shared_ptr<BlobAllocator> getDefaultAllocator() {
+    static std::shared_ptr<BlobAllocator> allocator = std::make_shared<AlignedAllocator>();
+    return allocator;
+}
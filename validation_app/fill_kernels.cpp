@@ -0,0 +1,379 @@
+// Copyright 2021 the dldt tools authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+
+#include "fill_kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FILL_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+// pixels of one SIMD block, 48 bytes of the source row
+static const size_t BLOCK = 16;
+
+FillIsa detectFillIsa() {
+#ifdef FILL_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return FillIsa::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return FillIsa::AVX2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return FillIsa::SSSE3;
+    }
+#endif
+    return FillIsa::Scalar;
+}
+
+static FillIsa fillIsa = detectFillIsa();
+
+FillIsa setFillIsa(FillIsa isa) {
+    fillIsa = std::min(isa, detectFillIsa());
+    return fillIsa;
+}
+
+const char* fillIsaName(FillIsa isa) {
+    switch (isa) {
+    case FillIsa::SSSE3:
+        return "SSSE3";
+    case FillIsa::AVX2:
+        return "AVX2";
+    case FillIsa::AVX512:
+        return "AVX-512";
+    default:
+        return "scalar";
+    }
+}
+
+PixelConverter::PixelConverter(const PixelTransform &transform) : _transform(transform) {
+    _copy = true;
+    for (int d = 0; d < 3; d++) {
+        _copy = _copy && transform.scale[d] == 1.f && transform.shift[d] == 0.f;
+    }
+    // value j of the output block is channel d of pixel i, planar block is 16 values of channel 0, 1 and 2,
+    // interleaved one is 16 pixels as they are
+    for (int interleaved = 0; interleaved < 2; interleaved++) {
+        for (size_t j = 0; j < 3 * BLOCK; j++) {
+            size_t i = interleaved ? j / 3 : j % BLOCK;
+            size_t d = interleaved ? j % 3 : j / BLOCK;
+            size_t source = 3 * i + transform.order[d];
+            for (size_t input = 0; input < 3; input++) {
+                _masks[interleaved][j / BLOCK][input][j % BLOCK] =
+                    source / BLOCK == input ? static_cast<uint8_t>(source % BLOCK) : 0x80;
+            }
+            _scale[interleaved][j] = transform.scale[d];
+            _shift[interleaved][j] = transform.shift[d];
+        }
+    }
+}
+
+#ifdef FILL_KERNELS_X86
+/**
+ * Reorders 16 pixels into 3 vectors by the masks, a value is taken from one of 3 source vectors
+ */
+__attribute__((target("ssse3"))) static inline void permute(const uint8_t *src, const uint8_t (*masks)[3][16],
+                                                             __m128i *out) {
+    const __m128i s0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    const __m128i s1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + BLOCK));
+    const __m128i s2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * BLOCK));
+    for (size_t k = 0; k < 3; k++) {
+        const __m128i* m = reinterpret_cast<const __m128i*>(masks[k]);
+        out[k] = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(s0, _mm_load_si128(m)),
+                                           _mm_shuffle_epi8(s1, _mm_load_si128(m + 1))),
+                              _mm_shuffle_epi8(s2, _mm_load_si128(m + 2)));
+    }
+}
+
+// destination of output vector k of the block starting at pixel w
+static inline size_t blockOffset(bool interleaved, size_t w, size_t k, size_t cStride) {
+    return interleaved ? 3 * w + k * BLOCK : k * cStride + w;
+}
+
+__attribute__((target("ssse3"))) static size_t copySSSE3(const uint8_t *src, size_t width, uint8_t *dst,
+                                                         size_t cStride, bool interleaved, const uint8_t (*masks)[3][16]) {
+    size_t w = 0;
+    for (; w + BLOCK <= width; w += BLOCK) {
+        __m128i out[3];
+        permute(src + 3 * w, masks, out);
+        for (size_t k = 0; k < 3; k++) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + blockOffset(interleaved, w, k, cStride)), out[k]);
+        }
+    }
+    return w;
+}
+
+__attribute__((target("ssse3"))) static size_t convertSSSE3(const uint8_t *src, size_t width, float *dst,
+                                                            size_t cStride, bool interleaved, const uint8_t (*masks)[3][16],
+                                                            const float *scale, const float *shift) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t w = 0;
+    for (; w + BLOCK <= width; w += BLOCK) {
+        __m128i out[3];
+        permute(src + 3 * w, masks, out);
+        for (size_t k = 0; k < 3; k++) {
+            const __m128i lo = _mm_unpacklo_epi8(out[k], zero);
+            const __m128i hi = _mm_unpackhi_epi8(out[k], zero);
+            const __m128i q[4] = { _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+                                   _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero) };
+            float *o = dst + blockOffset(interleaved, w, k, cStride);
+            for (size_t n = 0; n < 4; n++) {
+                __m128 v = _mm_mul_ps(_mm_cvtepi32_ps(q[n]), _mm_loadu_ps(scale + k * BLOCK + 4 * n));
+                _mm_storeu_ps(o + 4 * n, _mm_add_ps(v, _mm_loadu_ps(shift + k * BLOCK + 4 * n)));
+            }
+        }
+    }
+    return w;
+}
+
+__attribute__((target("avx2"))) static size_t convertAVX2(const uint8_t *src, size_t width, float *dst,
+                                                          size_t cStride, bool interleaved, const uint8_t (*masks)[3][16],
+                                                          const float *scale, const float *shift) {
+    size_t w = 0;
+    for (; w + BLOCK <= width; w += BLOCK) {
+        __m128i out[3];
+        permute(src + 3 * w, masks, out);
+        for (size_t k = 0; k < 3; k++) {
+            const __m256i q[2] = { _mm256_cvtepu8_epi32(out[k]), _mm256_cvtepu8_epi32(_mm_srli_si128(out[k], 8)) };
+            float *o = dst + blockOffset(interleaved, w, k, cStride);
+            for (size_t n = 0; n < 2; n++) {
+                __m256 v = _mm256_mul_ps(_mm256_cvtepi32_ps(q[n]), _mm256_loadu_ps(scale + k * BLOCK + 8 * n));
+                _mm256_storeu_ps(o + 8 * n, _mm256_add_ps(v, _mm256_loadu_ps(shift + k * BLOCK + 8 * n)));
+            }
+        }
+    }
+    return w;
+}
+
+__attribute__((target("avx512f"))) static size_t convertAVX512(const uint8_t *src, size_t width, float *dst,
+                                                               size_t cStride, bool interleaved, const uint8_t (*masks)[3][16],
+                                                               const float *scale, const float *shift) {
+    size_t w = 0;
+    for (; w + BLOCK <= width; w += BLOCK) {
+        __m128i out[3];
+        permute(src + 3 * w, masks, out);
+        for (size_t k = 0; k < 3; k++) {
+            // zero masking forms, GCC warns about undefined vector merged by the plain ones
+            const __m512i q = _mm512_maskz_cvtepu8_epi32(0xFFFF, out[k]);
+            __m512 v = _mm512_mul_ps(_mm512_maskz_cvtepi32_ps(0xFFFF, q), _mm512_loadu_ps(scale + k * BLOCK));
+            _mm512_storeu_ps(dst + blockOffset(interleaved, w, k, cStride), _mm512_add_ps(v, _mm512_loadu_ps(shift + k * BLOCK)));
+        }
+    }
+    return w;
+}
+#endif
+
+void PixelConverter::convert(const uint8_t *src, size_t width, float *dst, size_t wStride, size_t cStride) const {
+    size_t w = 0;
+#ifdef FILL_KERNELS_X86
+    const bool planar = wStride == 1;
+    const bool interleaved = wStride == 3 && cStride == 1;
+    if (planar || interleaved) {
+        const int i = interleaved ? 1 : 0;
+        switch (fillIsa) {
+        case FillIsa::AVX512:
+            w = convertAVX512(src, width, dst, cStride, interleaved, _masks[i], _scale[i], _shift[i]);
+            break;
+        case FillIsa::AVX2:
+            w = convertAVX2(src, width, dst, cStride, interleaved, _masks[i], _scale[i], _shift[i]);
+            break;
+        case FillIsa::SSSE3:
+            w = convertSSSE3(src, width, dst, cStride, interleaved, _masks[i], _scale[i], _shift[i]);
+            break;
+        default:
+            break;
+        }
+    }
+#endif
+    // channel by channel, so the compiler vectorizes loops of unit stride at least
+    for (size_t d = 0; d < 3; d++) {
+        const uint8_t *s = src + _transform.order[d];
+        float *o = dst + d * cStride;
+        const float scale = _transform.scale[d];
+        const float shift = _transform.shift[d];
+        if (wStride == 1) {
+            for (size_t x = w; x < width; x++) {
+                o[x] = static_cast<float>(s[3 * x]) * scale + shift;
+            }
+        } else {
+            for (size_t x = w; x < width; x++) {
+                o[x * wStride] = static_cast<float>(s[3 * x]) * scale + shift;
+            }
+        }
+    }
+}
+
+void PixelConverter::convert(const uint8_t *src, size_t width, uint8_t *dst, size_t wStride, size_t cStride) const {
+    size_t w = 0;
+    if (_copy) {
+#ifdef FILL_KERNELS_X86
+        const bool planar = wStride == 1;
+        const bool interleaved = wStride == 3 && cStride == 1;
+        if ((planar || interleaved) && fillIsa != FillIsa::Scalar) {
+            w = copySSSE3(src, width, dst, cStride, interleaved, _masks[interleaved ? 1 : 0]);
+        }
+#endif
+        for (size_t d = 0; d < 3; d++) {
+            const uint8_t *s = src + _transform.order[d];
+            uint8_t *o = dst + d * cStride;
+            for (size_t x = w; x < width; x++) {
+                o[x * wStride] = s[3 * x];
+            }
+        }
+        return;
+    }
+    for (; w < width; w++) {
+        for (size_t d = 0; d < 3; d++) {
+            dst[w * wStride + d * cStride] = static_cast<uint8_t>(std::min(255.f, std::max(0.f, value(src + 3 * w, d))));
+        }
+    }
+}
+
+#ifdef FILL_KERNELS_X86
+// bilinear weights are fixed point numbers of 11 fraction bits, as in cv::resize
+static const int RESIZE_COEF_BITS = 11;
+static const int RESIZE_COEF_SCALE = 1 << RESIZE_COEF_BITS;
+
+/**
+ * Two source pixels of a destination pixel and their weights
+ */
+struct LinearTap {
+    int index[2];
+    int16_t weight[2];
+};
+
+/**
+ * @return taps of destination pixels [first, first + count) of the dimension resized from srcSize to dstSize,
+ *         computed as cv::resize does for bilinear interpolation
+ */
+static std::vector<LinearTap> linearTaps(int srcSize, int dstSize, int first, int count) {
+    const double scale = 1. / (static_cast<double>(dstSize) / srcSize);
+    std::vector<LinearTap> taps(count);
+    for (int i = 0; i < count; i++) {
+        float f = static_cast<float>((first + i + 0.5) * scale - 0.5);
+        int s = static_cast<int>(std::floor(f));
+        f -= s;
+        if (s < 0) {
+            s = 0;
+            f = 0.f;
+        }
+        if (s >= srcSize - 1) {
+            s = srcSize - 1;
+            f = 0.f;
+        }
+        taps[i].index[0] = s;
+        taps[i].index[1] = std::min(s + 1, srcSize - 1);
+        taps[i].weight[0] = static_cast<int16_t>(std::lrint((1.f - f) * RESIZE_COEF_SCALE));
+        taps[i].weight[1] = static_cast<int16_t>(std::lrint(f * RESIZE_COEF_SCALE));
+    }
+    return taps;
+}
+
+/**
+ * Interpolates the source row horizontally to 16 bit values, 4 pixels at once. Pair of values of the left and
+ * the right pixel is multiplied by pair of weights of the channel and summed by pmaddwd
+ * @return number of pixels done, the rest is left as 8 bytes are read from the left pixel
+ */
+__attribute__((target("ssse3"))) static int resizeRowSSSE3(const uint8_t *s, int srcWidth, const LinearTap *columns,
+                                                            int count, const int16_t *weights, int16_t *h) {
+    // pairs of channels of pixels 0 and 1, then 2 and 3, loaded as 8 bytes each
+    const __m128i m0 = _mm_setr_epi8(0, -1, 3, -1, 1, -1, 4, -1, 2, -1, 5, -1, 8, -1, 11, -1);
+    const __m128i m1 = _mm_setr_epi8(9, -1, 12, -1, 10, -1, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i m2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, 0, -1, 3, -1, 1, -1, 4, -1);
+    const __m128i m3 = _mm_setr_epi8(2, -1, 5, -1, 8, -1, 11, -1, 9, -1, 12, -1, 10, -1, 13, -1);
+    int dx = 0;
+    for (; dx + 4 <= count && columns[dx + 3].index[0] + 3 <= srcWidth; dx += 4) {
+        const __m128i* p[4];
+        for (int i = 0; i < 4; i++) {
+            p[i] = reinterpret_cast<const __m128i*>(s + columns[dx + i].index[0] * 3);
+        }
+        const __m128i p01 = _mm_unpacklo_epi64(_mm_loadl_epi64(p[0]), _mm_loadl_epi64(p[1]));
+        const __m128i p23 = _mm_unpacklo_epi64(_mm_loadl_epi64(p[2]), _mm_loadl_epi64(p[3]));
+        const __m128i* w = reinterpret_cast<const __m128i*>(weights + dx * 6);
+        const __m128i v0 = _mm_madd_epi16(_mm_shuffle_epi8(p01, m0), _mm_loadu_si128(w));
+        const __m128i v1 = _mm_madd_epi16(_mm_or_si128(_mm_shuffle_epi8(p01, m1), _mm_shuffle_epi8(p23, m2)),
+                                          _mm_loadu_si128(w + 1));
+        const __m128i v2 = _mm_madd_epi16(_mm_shuffle_epi8(p23, m3), _mm_loadu_si128(w + 2));
+        const __m128i v01 = _mm_packs_epi32(_mm_srai_epi32(v0, 4), _mm_srai_epi32(v1, 4));
+        const __m128i v22 = _mm_packs_epi32(_mm_srai_epi32(v2, 4), _mm_srai_epi32(v2, 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(h + dx * 3), v01);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(h + dx * 3 + 8), v22);
+    }
+    return dx;
+}
+
+/**
+ * Interpolates two horizontally interpolated rows vertically, as SIMD code of cv::resize does
+ */
+__attribute__((target("ssse3"))) static void resizeColumnsSSSE3(const int16_t *h0, const int16_t *h1, size_t size,
+                                                                int16_t w0, int16_t w1, uint8_t *d) {
+    const __m128i b0 = _mm_set1_epi16(w0);
+    const __m128i b1 = _mm_set1_epi16(w1);
+    const __m128i delta = _mm_set1_epi16(2);
+    size_t x = 0;
+    for (; x + 16 <= size; x += 16) {
+        __m128i v[2];
+        for (size_t i = 0; i < 2; i++) {
+            const __m128i s0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(h0 + x + 8 * i));
+            const __m128i s1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(h1 + x + 8 * i));
+            v[i] = _mm_adds_epi16(_mm_mulhi_epi16(s0, b0), _mm_mulhi_epi16(s1, b1));
+            v[i] = _mm_srai_epi16(_mm_adds_epi16(v[i], delta), 2);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + x), _mm_packus_epi16(v[0], v[1]));
+    }
+    for (; x < size; x++) {
+        const int value = (((h0[x] * w0) >> 16) + ((h1[x] * w1) >> 16) + 2) >> 2;
+        d[x] = static_cast<uint8_t>(std::min(std::max(value, 0), 255));
+    }
+}
+#endif
+
+bool resizeCropLinear(const uint8_t *src, size_t srcStep, int srcWidth, int srcHeight, int resizedWidth, int resizedHeight,
+                      int cropX, int cropY, int cropWidth, int cropHeight, uint8_t *dst, size_t dstStep) {
+#ifdef FILL_KERNELS_X86
+    if (fillIsa == FillIsa::Scalar) {
+        return false;
+    }
+    const std::vector<LinearTap> columns = linearTaps(srcWidth, resizedWidth, cropX, cropWidth);
+    const std::vector<LinearTap> rows = linearTaps(srcHeight, resizedHeight, cropY, cropHeight);
+    const size_t rowSize = static_cast<size_t>(cropWidth) * 3;
+    // weights of the left and the right pixel for every value of the row
+    std::vector<int16_t> weights(2 * rowSize);
+    for (size_t i = 0; i < rowSize; i++) {
+        weights[2 * i] = columns[i / 3].weight[0];
+        weights[2 * i + 1] = columns[i / 3].weight[1];
+    }
+    // horizontally interpolated source rows, row y is kept in slot y % 2 as consecutive destination rows share them
+    std::vector<int16_t> buffer(2 * rowSize);
+    int buffered[2] = { -1, -1 };
+    for (int dy = 0; dy < cropHeight; dy++) {
+        const LinearTap &row = rows[dy];
+        for (int k = 0; k < 2; k++) {
+            const int y = row.index[k];
+            if (buffered[y & 1] == y) {
+                continue;
+            }
+            const uint8_t *s = src + y * srcStep;
+            int16_t *h = buffer.data() + (y & 1) * rowSize;
+            for (int dx = resizeRowSSSE3(s, srcWidth, columns.data(), cropWidth, weights.data(), h); dx < cropWidth; dx++) {
+                const LinearTap &column = columns[dx];
+                for (int c = 0; c < 3; c++) {
+                    h[dx * 3 + c] = static_cast<int16_t>((s[column.index[0] * 3 + c] * column.weight[0] +
+                                                          s[column.index[1] * 3 + c] * column.weight[1]) >> 4);
+                }
+            }
+            buffered[y & 1] = y;
+        }
+        resizeColumnsSSSE3(buffer.data() + (row.index[0] & 1) * rowSize, buffer.data() + (row.index[1] & 1) * rowSize,
+                           rowSize, row.weight[0], row.weight[1], dst + dy * dstStep);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,79 @@
+// Copyright 2021 the dldt tools authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Conversion of interleaved 3 channel U8 pixels to blob values. Destination channel d takes source channel
+ * order[d] as value * scale[d] + shift[d], so channel reordering, mean subtraction and scaling are done at once
+ */
+struct PixelTransform {
+    int order[3] = { 0, 1, 2 };
+    float scale[3] = { 1.f, 1.f, 1.f };
+    float shift[3] = { 0.f, 0.f, 0.f };
+};
+
+/// Instruction sets of the fill kernels, from the narrowest one
+enum class FillIsa { Scalar, SSSE3, AVX2, AVX512 };
+
+/**
+ * @return the widest instruction set the CPU supports
+ */
+FillIsa detectFillIsa();
+/**
+ * Limits kernels to the instruction set, for comparison of them. Instruction sets the CPU does not support
+ * are not set
+ * @return instruction set in use
+ */
+FillIsa setFillIsa(FillIsa isa);
+const char* fillIsaName(FillIsa isa);
+
+/**
+ * Fills rows of a blob from rows of an image in one pass. Element of column w and channel d of the row is
+ * dst[w * wStride + d * cStride]. Planar rows (wStride 1) and interleaved rows (wStride 3, cStride 1) are converted
+ * by SIMD kernels, 16 pixels at once, others and the tail of the row by scalar code. Float results of all
+ * kernels are the same, value * scale + shift is computed without fused multiply-add
+ */
+class PixelConverter {
+public:
+    explicit PixelConverter(const PixelTransform &transform);
+
+    void convert(const uint8_t *src, size_t width, float *dst, size_t wStride, size_t cStride) const;
+    // U8 values out of range are saturated
+    void convert(const uint8_t *src, size_t width, uint8_t *dst, size_t wStride, size_t cStride) const;
+    // other precisions are converted by scalar code only
+    template <class T>
+    void convert(const uint8_t *src, size_t width, T *dst, size_t wStride, size_t cStride) const {
+        for (size_t w = 0; w < width; w++) {
+            for (size_t d = 0; d < 3; d++) {
+                dst[w * wStride + d * cStride] = static_cast<T>(value(src + 3 * w, d));
+            }
+        }
+    }
+
+private:
+    float value(const uint8_t *pixel, size_t d) const {
+        return static_cast<float>(pixel[_transform.order[d]]) * _transform.scale[d] + _transform.shift[d];
+    }
+
+    PixelTransform _transform;
+    // transform keeps values, U8 rows are only reordered
+    bool _copy;
+    // shuffle masks of 16 pixel block, [interleaved][output vector][input vector]
+    alignas(16) uint8_t _masks[2][3][3][16];
+    // scale and shift of every value of the block, [interleaved][value]
+    alignas(64) float _scale[2][48];
+    alignas(64) float _shift[2][48];
+};
+
+/**
+ * Bilinear resize of 3 channel U8 image to resizedWidth x resizedHeight, giving only the crop of the result.
+ * Pixels out of the crop are not interpolated and source rows above and below it are not read. Values are the
+ * ones cv::resize gives, its fixed point arithmetic is repeated
+ * @return false if the CPU has no SSSE3, dst is not written then
+ */
+bool resizeCropLinear(const uint8_t *src, size_t srcStep, int srcWidth, int srcHeight, int resizedWidth, int resizedHeight,
+                      int cropX, int cropY, int cropWidth, int cropHeight, uint8_t *dst, size_t dstStep);
@@ -16,130 +16,22 @@
 
 using namespace cv;
 
-int getLoadModeForChannels(int channels, int base) {
-    switch (channels) {
-    case 1:
-        return base | IMREAD_GRAYSCALE;
-    case 3:
-        return base | IMREAD_COLOR;
-    }
-    return base | IMREAD_UNCHANGED;
-}
-
-template <class T>
-cv::Size addToBlob(std::string name, int batch_pos, VBlob* blob, PreprocessingOptions preprocessingOptions) {
-    VShape blobSize = blob->_shape;
-    int width = blob->_layout == "NCHW" ? static_cast<int>(blobSize[3]) : static_cast<int>(blobSize[2]);
-    int height = blob->_layout == "NCHW" ? static_cast<int>(blobSize[2]) : static_cast<int>(blobSize[1]);
-    int channels = blob->_layout == "NCHW" ? static_cast<int>(blobSize[1]) : static_cast<int>(blobSize[3]);
-    T* blob_data = static_cast<T*>(blob->_data);
-    Mat orig_image, result_image;
-    int loadMode = getLoadModeForChannels(channels, 0);
-
-    std::string tryName = name;
-
+static std::string imageFileName(const std::string &name) {
     // TODO This is a dirty hack to support VOC2007 (where no file extension is put into annotation).
     //      Rewrite.
-    if (name.find('.') == std::string::npos) tryName = name + ".JPEG";
-
-    orig_image = imread(tryName, loadMode);
-
-    if (orig_image.empty()) {
-        THROW_USER_EXCEPTION(1) << "Cannot open image file: " << tryName;
-    }
-
-    // Preprocessing the image
-    Size res = orig_image.size();
-
-    if (preprocessingOptions.resizeCropPolicy == ResizeCropPolicy::Resize) {
-        cv::resize(orig_image, result_image, Size(width, height));
-    } else if (preprocessingOptions.resizeCropPolicy == ResizeCropPolicy::ResizeThenCrop) {
-        Mat resized_image;
-
-        cv::resize(orig_image, resized_image, Size(preprocessingOptions.resizeBeforeCropX, preprocessingOptions.resizeBeforeCropY));
+    if (name.find('.') == std::string::npos) return name + ".JPEG";
+    return name;
+}
 
-        size_t cx = preprocessingOptions.resizeBeforeCropX / 2;
-        size_t cy = preprocessingOptions.resizeBeforeCropY / 2;
+Mat readImage(const std::string &name, int loadMode) {
+    std::string tryName = imageFileName(name);
 
-        cv::Rect cropRect(cx - width / 2, cy - height / 2, width, height);
-        result_image = resized_image(cropRect);
-    } else if (preprocessingOptions.resizeCropPolicy == ResizeCropPolicy::DoNothing) {
-        // No image preprocessing to be done here
-        result_image = orig_image;
-    } else {
-        THROW_USER_EXCEPTION(1) << "Unsupported ResizeCropPolicy value";
-    }
+    Mat image = imread(tryName, loadMode);
 
-    float scaleFactor = preprocessingOptions.scaleValuesTo01 ? 255.0f : 1.0f;
-
-    if (blob->_layout == "NCHW") {
-        for (int c = 0; c < channels; c++) {
-            for (int h = 0; h < height; h++) {
-                for (int w = 0; w < width; w++) {
-                    blob_data[batch_pos * channels * width * height + c * width * height + h * width + w] =
-                        static_cast<T>(result_image.at<cv::Vec3b>(h, w)[c] / scaleFactor);
-                }
-            }
-        }
-        if (blob->_colourFormat == "RGB") {
-
-          // TODO: to implement different way
-          // reverse channels & do normalization
-          for (int c = 0; c < channels; c++) {
-            float sub = 0.f;
-            float div = 1.f;
-            if (c == 2) {
-                sub = 123.6f;
-                div = 58.395f;
-            }
-            if (c == 1) {
-                sub = 116.3f;
-                div = 57.12f;
-            }
-            if (c == 0) {
-                sub = 103.5f;
-                div = 57.375f;
-            }
-            for (int h = 0; h < height; h++) {
-              for (int w = 0; w < width; w++) {
-                size_t idx = batch_pos * channels * width * height + c * width * height + h * width + w;
-                blob_data[idx] = (blob_data[idx] - sub) / div;
-              }
-            }
-          }
-          for (int h = 0; h < height; h++) {
-            for (int w = 0; w < width; w++) {
-              size_t idx0 = batch_pos * channels * width * height + 0 * width * height + h * width + w;
-              size_t idx2 = batch_pos * channels * width * height + 2 * width * height + h * width + w;
-              float tmp = blob_data[idx0];
-              blob_data[idx0] = blob_data[idx2];
-              blob_data[idx2] = tmp;
-            }
-          }
-        }
-    } else if (blob->_layout == "NHWC") {
-        size_t nielements = width * height * channels;
-        if (blob->_precision == FP32) {
-            for (size_t i = 0; i < nielements; i++) {
-                blob_data[i] = (static_cast<float>(result_image.data[i]) - 128.f )/ 127.f;
-            }
-            if (blob->_colourFormat == "RGB") {
-                for (size_t i = 0; i < nielements; i += channels) {
-                    float tmp = blob_data[i];
-                    blob_data[i] = blob_data[i + 2];
-                    blob_data[i + 2] = tmp;
-                }
-            }
-        } else if (blob->_precision == U8) {
-            for (size_t i = 0; i < nielements; i += 3) {
-                blob_data[i] = result_image.data[i + 2];
-                blob_data[i+1] = result_image.data[i + 1];
-                blob_data[i+2] = result_image.data[i];
-            }
-        }
+    if (image.empty()) {
+        THROW_USER_EXCEPTION(1) << "Cannot open image file: " << tryName;
     }
-
-    return res;
+    return image;
 }
 
 std::map<std::string, cv::Size> convertToBlob(std::vector<std::string> names, int batch_pos, VBlob* blob, PreprocessingOptions preprocessingOptions) {
@@ -147,26 +39,12 @@ std::map<std::string, cv::Size> convertToBlob(std::vector<std::string> names, in
         THROW_USER_EXCEPTION(1) << "Blob was not allocated";
     }
 
-    std::function<cv::Size(std::string, int, VBlob*, PreprocessingOptions)> add_func;
-
-    switch (blob->_precision) {
-    case FP32:
-        add_func = &addToBlob<float>;
-        break;
-    case FP16:
-    case Q78:
-    case I16:
-    case U16:
-        add_func = &addToBlob<short>;
-        break;
-    default:
-        add_func = &addToBlob<uint8_t>;
-    }
-
+    PreprocessingPlan plan(preprocessingOptions, *blob);
+    ImageDecoder decoder;
     std::map<std::string, Size> res;
     for (size_t b = 0; b < names.size(); b++) {
         std::string name = names[b];
-        Size orig_size = add_func(name, batch_pos + b, blob, preprocessingOptions);
+        Size orig_size = decoder.insertIntoBlob(name, batch_pos + b, blob, plan);
         res.insert(std::pair<std::string, Size>(name, orig_size));
     }
 
@@ -183,5 +61,37 @@ std::map<std::string, cv::Size> ImageDecoder::loadToBlob(std::vector<std::string
 }
 
 Size ImageDecoder::insertIntoBlob(std::string name, int batch_pos, std::shared_ptr<VBlob> blob, PreprocessingOptions preprocessingOptions) {
-    return convertToBlob({ name }, batch_pos, blob.get(), preprocessingOptions).at(name);
+    return insertIntoBlob(name, batch_pos, blob.get(), preprocessingOptions);
+}
+
+Size ImageDecoder::insertIntoBlob(std::string name, int batch_pos, VBlob* blob, PreprocessingOptions preprocessingOptions) {
+    return convertToBlob({ name }, batch_pos, blob, preprocessingOptions).at(name);
+}
+
+Size ImageDecoder::insertIntoBlob(std::string name, int batch_pos, VBlob* blob, const PreprocessingPlan& plan) {
+    Mat image;
+    Size size;
+    if (!_jpeg.decode(imageFileName(name), plan.loadMode(), plan.decodeSize(), image, size)) {
+        image = readImage(name, plan.loadMode());
+        size = image.size();
+    }
+    plan.apply(image, blob, batch_pos);
+    return size;
+}
+
+std::shared_ptr<VBlob> ImageDecoder::decodeImage(std::string name) {
+    std::shared_ptr<Mat> image = std::make_shared<Mat>(readImage(name, getLoadModeForChannels(3, 0)));
+    if (!image->isContinuous()) {
+        *image = image->clone();
+    }
+
+    std::shared_ptr<VBlob> blob = std::make_shared<VBlob>();
+    blob->_shape = { 1, static_cast<size_t>(image->rows), static_cast<size_t>(image->cols), 3 };
+    blob->_precision = U8;
+    blob->_layout = NHWC;
+    blob->_colourFormat = BGR;
+    blob->_data = image->data;
+    // blob keeps the decoded image alive, pixels are not copied
+    blob->_memory = image;
+    return blob;
 }
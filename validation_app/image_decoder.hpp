@@ -15,9 +15,14 @@
 
 #include "PreprocessingOptions.hpp"
 #include "backend.hpp"
+#include "jpeg_decoder.hpp"
+#include "preprocessing_plan.hpp"
 
 using namespace cv;
 
+/**
+ * Decoder of images, buffers of JPEG decoding are kept between images, so a decoder serves one thread
+ */
 class ImageDecoder {
 public:
     /**
@@ -45,4 +50,22 @@ public:
      * @return original image size
      */
     Size insertIntoBlob(std::string name, int batch_pos, std::shared_ptr<VBlob> blob, PreprocessingOptions preprocessingOptions);
+    Size insertIntoBlob(std::string name, int batch_pos, VBlob* blob, PreprocessingOptions preprocessingOptions);
+    /**
+     * @brief Insert image data to blob at specified batch position by the plan built for the blob format.
+     *        Does no checks if blob has sufficient space. JPEG images are decoded reduced to the decode size
+     *        of the plan if libjpeg is available
+     * @return original image size
+     */
+    Size insertIntoBlob(std::string name, int batch_pos, VBlob* blob, const PreprocessingPlan& plan);
+
+    /**
+     * @brief Decode image without any preprocessing, for backends resizing images themselves
+     * @param name - image file name
+     * @return U8 BGR blob of NHWC layout and the original image size, owning the decoded pixels
+     */
+    std::shared_ptr<VBlob> decodeImage(std::string name);
+
+private:
+    JpegDecoder _jpeg;
 };
@@ -0,0 +1,83 @@
+// Copyright 2021 the dldt tools authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+
+#include <algorithm>
+#include <chrono>
+
+#include "image_prefetcher.hpp"
+
+ImagePrefetcher::ImagePrefetcher(const std::vector<std::string> &files, size_t threads, size_t depth, Decode decode)
+    : _files(files), _slots(std::max<size_t>(1, depth)), _decode(decode) {
+    // no more workers than slots, the rest would wait for slots all the time
+    threads = std::min(threads, _slots.size());
+    for (size_t t = 0; t < threads; t++) {
+        _workers.emplace_back([this]() { run(); });
+    }
+}
+
+ImagePrefetcher::~ImagePrefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _cv.notify_all();
+    for (auto &worker : _workers) {
+        worker.join();
+    }
+}
+
+void ImagePrefetcher::run() {
+    ImageDecoder decoder;
+    for (;;) {
+        size_t index;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cv.wait(lock, [this]() {
+                return _stop || _next >= _files.size() || _next < _consumed + _slots.size();
+            });
+            if (_stop || _next >= _files.size()) {
+                return;
+            }
+            index = _next++;
+        }
+
+        // the slot belongs to this worker until it is marked ready, it is filled without the lock
+        Image &image = _slots[index % _slots.size()];
+        image.file = _files[index];
+        image.error = nullptr;
+        auto start = std::chrono::high_resolution_clock::now();
+        try {
+            image.size = _decode(decoder, image.file, image.blob);
+        } catch (...) {
+            image.error = std::current_exception();
+        }
+        image.decodeTime = std::chrono::duration_cast<std::chrono::duration<double, std::ratio<1, 1000>>>(
+            std::chrono::high_resolution_clock::now() - start).count();
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            image.ready = true;
+        }
+        _cv.notify_all();
+    }
+}
+
+const ImagePrefetcher::Image &ImagePrefetcher::front() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    Image &image = _slots[_consumed % _slots.size()];
+    if (_workers.empty()) {
+        image.file = _files.at(_consumed);
+        image.ready = true;
+    }
+    _cv.wait(lock, [&image]() { return image.ready; });
+    return image;
+}
+
+void ImagePrefetcher::pop() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _slots[_consumed % _slots.size()].ready = false;
+        _consumed++;
+    }
+    _cv.notify_all();
+}
@@ -0,0 +1,75 @@
+// Copyright 2021 the dldt tools authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "image_decoder.hpp"
+
+/**
+ * Decodes images of the list by worker threads ahead of the inference. Images are given to the consumer in the
+ * order of the list, every one is decoded into a slot of the ring, so at most `depth` images are decoded ahead
+ * of the consumer and the slot memory is reused. Without threads nothing is decoded ahead, the consumer gets
+ * file names only
+ */
+class ImagePrefetcher {
+public:
+    /**
+     * Decodes the file into the blob of the slot, the blob is null on the first use of the slot
+     * @return original image size
+     */
+    typedef std::function<Size(ImageDecoder &decoder, const std::string &file, std::shared_ptr<VBlob> &blob)> Decode;
+
+    struct Image {
+        std::string file;
+        // decoded image, null if it is not prefetched
+        std::shared_ptr<VBlob> blob;
+        Size size;
+        // exception thrown by decoding, it is rethrown by the consumer
+        std::exception_ptr error;
+        // time of decoding in the worker, ms
+        double decodeTime = 0;
+        bool ready = false;
+    };
+
+    ImagePrefetcher(const std::vector<std::string> &files, size_t threads, size_t depth, Decode decode);
+    ~ImagePrefetcher();
+
+    ImagePrefetcher(const ImagePrefetcher &) = delete;
+    ImagePrefetcher &operator=(const ImagePrefetcher &) = delete;
+
+    /**
+     * Waits until the next image of the list is decoded, the image is valid until pop()
+     */
+    const Image &front();
+    /**
+     * Gives the slot of the front image back to workers
+     */
+    void pop();
+
+    size_t threads() const {
+        return _workers.size();
+    }
+
+private:
+    void run();
+
+    std::vector<std::string> _files;
+    std::vector<Image> _slots;
+    Decode _decode;
+    // index of the next file to decode and of the file the consumer is at
+    size_t _next = 0;
+    size_t _consumed = 0;
+    bool _stop = false;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::vector<std::thread> _workers;
+};
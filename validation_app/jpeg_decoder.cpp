@@ -0,0 +1,169 @@
+// Copyright 2021 the dldt tools authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+
+#include "jpeg_decoder.hpp"
+
+#ifdef HAVE_LIBJPEG
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include <jpeglib.h>
+
+/**
+ * Errors of libjpeg jump back to the decode call instead of exiting
+ */
+struct JpegError {
+    jpeg_error_mgr manager;
+    jmp_buf jump;
+};
+
+static void onJpegError(j_common_ptr cinfo) {
+    longjmp(reinterpret_cast<JpegError*>(cinfo->err)->jump, 1);
+}
+
+// warnings about corrupt data are not printed, such images are decoded as OpenCV does
+static void onJpegMessage(j_common_ptr) { }
+
+struct JpegDecoder::Impl {
+    jpeg_decompress_struct cinfo;
+    JpegError error;
+    std::vector<uint8_t> file;
+    std::vector<uint8_t> pixels;
+};
+
+static bool readFile(const std::string &name, std::vector<uint8_t> &data) {
+    std::ifstream file(name, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return false;
+    }
+    const std::streamoff size = file.tellg();
+    if (size <= 0) {
+        return false;
+    }
+    data.resize(static_cast<size_t>(size));
+    file.seekg(0);
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(data.data()), size));
+}
+
+/**
+ * @return orientation tag of EXIF data in APP1 marker, 1 (as stored) if there is none
+ */
+static unsigned exifOrientation(j_decompress_ptr cinfo) {
+    for (jpeg_saved_marker_ptr marker = cinfo->marker_list; marker != nullptr; marker = marker->next) {
+        if (marker->marker != JPEG_APP0 + 1 || marker->data_length < 14 ||
+            std::memcmp(marker->data, "Exif\0\0", 6) != 0) {
+            continue;
+        }
+        // TIFF header and IFD0 entries of 12 bytes: tag, type, count and value
+        const uint8_t *tiff = marker->data + 6;
+        const size_t size = marker->data_length - 6;
+        const bool littleEndian = tiff[0] == 'I';
+        auto read = [&](size_t offset, size_t bytes) {
+            unsigned value = 0;
+            for (size_t i = 0; i < bytes; i++) {
+                value |= static_cast<unsigned>(tiff[offset + i]) << (8 * (littleEndian ? i : bytes - 1 - i));
+            }
+            return value;
+        };
+        const size_t ifd = read(4, 4);
+        if (ifd + 2 > size) {
+            return 1;
+        }
+        const size_t count = read(ifd, 2);
+        for (size_t entry = ifd + 2; entry < ifd + 2 + 12 * count && entry + 12 <= size; entry += 12) {
+            if (read(entry, 2) == 0x0112) {
+                return read(entry + 8, 2);
+            }
+        }
+    }
+    return 1;
+}
+
+JpegDecoder::JpegDecoder() : _impl(new Impl()) {
+    _impl->cinfo.err = jpeg_std_error(&_impl->error.manager);
+    _impl->error.manager.error_exit = onJpegError;
+    _impl->error.manager.output_message = onJpegMessage;
+    jpeg_create_decompress(&_impl->cinfo);
+}
+
+JpegDecoder::~JpegDecoder() {
+    jpeg_destroy_decompress(&_impl->cinfo);
+}
+
+bool JpegDecoder::decode(const std::string &file, int loadMode, cv::Size minSize, cv::Mat &image, cv::Size &size) {
+    if (loadMode != cv::IMREAD_COLOR && loadMode != cv::IMREAD_GRAYSCALE) {
+        return false;
+    }
+    Impl &d = *_impl;
+    if (!readFile(file, d.file) || d.file.size() < 3 || d.file[0] != 0xFF || d.file[1] != 0xD8 || d.file[2] != 0xFF) {
+        return false;
+    }
+
+    jpeg_decompress_struct &cinfo = d.cinfo;
+    if (setjmp(d.error.jump)) {
+        jpeg_abort_decompress(&cinfo);
+        return false;
+    }
+    jpeg_mem_src(&cinfo, d.file.data(), static_cast<unsigned long>(d.file.size()));
+    jpeg_save_markers(&cinfo, JPEG_APP0 + 1, 0xFFFF);
+    jpeg_read_header(&cinfo, TRUE);
+    if (cinfo.num_components == 4 || exifOrientation(&cinfo) > 1) {
+        jpeg_abort_decompress(&cinfo);
+        return false;
+    }
+    const int channels = loadMode == cv::IMREAD_COLOR ? 3 : 1;
+    cinfo.out_color_space = channels == 3 ? JCS_EXT_BGR : JCS_GRAYSCALE;
+    // the smallest scale keeping both dimensions not smaller than minSize, libjpeg rounds them up
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = 1;
+    if (minSize.width > 0 && minSize.height > 0) {
+        for (unsigned denom = 8; denom > 1; denom /= 2) {
+            if ((cinfo.image_width + denom - 1) / denom >= static_cast<unsigned>(minSize.width) &&
+                (cinfo.image_height + denom - 1) / denom >= static_cast<unsigned>(minSize.height)) {
+                cinfo.scale_denom = denom;
+                break;
+            }
+        }
+    }
+    jpeg_start_decompress(&cinfo);
+    const size_t step = static_cast<size_t>(cinfo.output_width) * channels;
+    // capacity is kept, the buffer is reallocated for images larger than all before only
+    d.pixels.resize(step * cinfo.output_height);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = d.pixels.data() + cinfo.output_scanline * step;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+
+    image = cv::Mat(static_cast<int>(cinfo.output_height), static_cast<int>(cinfo.output_width),
+                    channels == 3 ? CV_8UC3 : CV_8UC1, d.pixels.data(), step);
+    size = cv::Size(static_cast<int>(cinfo.image_width), static_cast<int>(cinfo.image_height));
+    return true;
+}
+
+bool JpegDecoder::isAvailable() {
+    return true;
+}
+
+#else
+
+struct JpegDecoder::Impl { };
+
+JpegDecoder::JpegDecoder() { }
+
+JpegDecoder::~JpegDecoder() { }
+
+bool JpegDecoder::decode(const std::string &, int, cv::Size, cv::Mat &, cv::Size &) {
+    return false;
+}
+
+bool JpegDecoder::isAvailable() {
+    return false;
+}
+
+#endif
@@ -0,0 +1,39 @@
+// Copyright 2021 the dldt tools authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <opencv2/core/core.hpp>
+
+/**
+ * Decoder of JPEG files by libjpeg-turbo. Images are reduced by scaled IDCT to 1/2, 1/4 or 1/8 as far as they stay
+ * not smaller than the size asked for. The file, the pixels and the decompressor are kept between images, so a
+ * decoder serves one thread. Without libjpeg at build time no file is decoded
+ */
+class JpegDecoder {
+public:
+    JpegDecoder();
+    ~JpegDecoder();
+    JpegDecoder(const JpegDecoder &) = delete;
+    JpegDecoder &operator=(const JpegDecoder &) = delete;
+
+    /**
+     * @param loadMode - IMREAD_COLOR or IMREAD_GRAYSCALE, images are BGR or gray as imread gives them
+     * @param minSize - decoded image is not smaller in any dimension, empty for the full size
+     * @param image - decoded image, pixels belong to the decoder and are valid till the next call
+     * @param size - size of the image in the file
+     * @return false if the file is not a JPEG the decoder gives the same image as imread for: other formats,
+     *         CMYK images and images rotated by EXIF orientation are left to OpenCV, as well as unreadable files
+     */
+    bool decode(const std::string &file, int loadMode, cv::Size minSize, cv::Mat &image, cv::Size &size);
+
+    /// @return false if libjpeg is not available at build time and no file is decoded
+    static bool isAvailable();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> _impl;
+};
@@ -8,6 +8,7 @@
  */
 #include <gflags/gflags.h>
 #include <algorithm>
+#include <cstdlib>
 #include <functional>
 #include <iostream>
 #include <map>
@@ -58,6 +59,31 @@ static const char target_device_message[] = "Target device to infer on: CPU (def
 static const char label_message[] = "Path to a file with labels for a model";
 /// @brief Message for batch argumenttype
 static const char batch_message[] = "Batch size value. If not specified, the batch size value is taken from IR";
+/// @brief Message for number of infer requests argument
+static const char nireq_message[] = "Number of infer requests kept in flight. While one request is inferred images"
+                                    " for the next one are decoded. 0 (default) lets the backend choose the optimal number,"
+                                    " backends which cannot tell it use 1";
+/// @brief Message for decode threads argument
+static const char decode_threads_message[] = "Number of threads decoding images ahead of the inference (1 by default)."
+                                             " 0 decodes images on the main thread right before the inference";
+/// @brief Message for prefetch depth argument
+static const char prefetch_message[] = "Number of batches decoded ahead of the inference by -decode_threads (2 by default)";
+/// @brief Message for backend config argument
+static const char config_message[] = "Backend configuration as comma separated KEY=VALUE pairs. Keys understood by every"
+                                     " backend: REQUESTS_NUM, INFERENCE_THREADS, STREAMS, CPU_BIND (YES/NO),"
+                                     " PERFORMANCE_PROFILE (LATENCY/THROUGHPUT/BALANCED/POWER_SAVER), PROFILING (YES/NO),"
+                                     " PREPROCESSING (YES/NO), MEAN_VALUES and STD_VALUES (set by -ppMean and -ppStd),"
+                                     " BATCH (set by -b). Other keys are passed to the backend runtime";
+/// @brief Message for backend config file argument
+static const char config_file_message[] = "Path to a file with backend configuration, one KEY=VALUE pair per line,"
+                                          " lines starting with # are ignored. Values of -config override the file";
+/// @brief Message for performance counters argument
+static const char pc_message[] = "Collect per-layer execution time and print the hotspot table in the report";
+/// @brief Message for performance counters export argument
+static const char pc_csv_message[] = "Export per-layer execution time to the .csv file, implies -pc";
+/// @brief Message for huge pages argument
+static const char huge_pages_message[] = "Back blobs of 2 MB and more allocated by the backend and the app with transparent "
+                                         "huge pages (Linux only)";
 /// @brief Message for dump argument
 static const char dump_message[] = "Dump file names and inference results to a .csv file";
 /// @brief Message for network type
@@ -68,6 +94,13 @@ static const char preprocessing_type[] = "Preprocessing type. Options: \"None\",
 static const char preprocessing_size[] = "Preprocessing size (used with ppType=\"ResizeCrop\")";
 static const char preprocessing_width[] = "Preprocessing width (overrides -ppSize, used with ppType=\"ResizeCrop\")";
 static const char preprocessing_height[] = "Preprocessing height (overrides -ppSize, used with ppType=\"ResizeCrop\")";
+static const char preprocessing_mean[] = "Mean of R, G and B channels subtracted from pixels, as \"R,G,B\". "
+                                         "The input format defines it by default";
+static const char preprocessing_std[] = "Deviation of R, G and B channels pixels are divided by, as \"R,G,B\". "
+                                        "The input format defines it by default";
+static const char preprocessing_scaled_decode[] = "Decode JPEG images reduced by 1/2, 1/4 or 1/8 when they stay not smaller "
+                                                  "than the resize size, pixels differ slightly from the full size decode "
+                                                  "(false by default, needs libjpeg at build time)";
 
 static const char obj_detection_annotations_message[] = "Required for Object Detection models. Path to a directory"
                                                         " containing an .xml file with annotations for images.";
@@ -132,6 +165,32 @@ DEFINE_string(d, "CPU", target_device_message);
 /// @brief Define parameter for batch size <br>
 /// Default is 0 (which means that batch size is not specified)
 DEFINE_int32(b, 0, batch_message);
+/// @brief Define parameter for number of infer requests <br>
+/// Default is 0: IE backend creates the optimal number of the device, other backends create 1
+DEFINE_int32(nireq, 0, nireq_message);
+
+/// @brief Define parameter for number of threads decoding images ahead of the inference <br>
+/// Default is 1, 0 decodes images on the main thread
+DEFINE_int32(decode_threads, 1, decode_threads_message);
+
+/// @brief Define parameter for number of batches decoded ahead of the inference <br>
+/// Default is 2
+DEFINE_int32(prefetch, 2, prefetch_message);
+
+/// @brief Define parameter for backend configuration
+DEFINE_string(config, "", config_message);
+
+/// @brief Define parameter for backend configuration file
+DEFINE_string(config_file, "", config_file_message);
+
+/// @brief Define flag for per-layer profiling
+DEFINE_bool(pc, false, pc_message);
+
+/// @brief Define parameter for per-layer profile export
+DEFINE_string(pc_csv, "", pc_csv_message);
+
+/// @brief Define flag for huge pages of blob memory
+DEFINE_bool(huge_pages, false, huge_pages_message);
 /// @brief Define flag to dump results to a file <br>
 DEFINE_bool(dump, false, dump_message);
 /// @brief Define parameter for a network type parameter
@@ -145,6 +204,13 @@ DEFINE_int32(ppSize, 0, preprocessing_size);
 DEFINE_int32(ppWidth, 0, preprocessing_width);
 DEFINE_int32(ppHeight, 0, preprocessing_height);
 
+/// @brief Define parameters for normalization of channels
+DEFINE_string(ppMean, "", preprocessing_mean);
+DEFINE_string(ppStd, "", preprocessing_std);
+
+/// @brief Define flag for decoding of JPEG images by scaled IDCT
+DEFINE_bool(ppScaledDecode, false, preprocessing_scaled_decode);
+
 DEFINE_bool(Czb, false, zero_background_message);
 
 DEFINE_string(ODa, "", obj_detection_annotations_message);
@@ -190,10 +256,21 @@ static void showUsage() {
     std::cout << "    -c <absolute_path>        " << custom_cldnn_message << std::endl;
     std::cout << "    -d <device>               " << target_device_message << std::endl;
     std::cout << "    -b N                      " << batch_message << std::endl;
+    std::cout << "    -nireq N                  " << nireq_message << std::endl;
+    std::cout << "    -decode_threads N         " << decode_threads_message << std::endl;
+    std::cout << "    -prefetch N               " << prefetch_message << std::endl;
+    std::cout << "    -config <KEY=VALUE,...>   " << config_message << std::endl;
+    std::cout << "    -config_file <path>       " << config_file_message << std::endl;
+    std::cout << "    -pc                       " << pc_message << std::endl;
+    std::cout << "    -pc_csv <path>            " << pc_csv_message << std::endl;
+    std::cout << "    -huge_pages               " << huge_pages_message << std::endl;
     std::cout << "    -ppType <type>            " << preprocessing_type << std::endl;
     std::cout << "    -ppSize N                 " << preprocessing_size << std::endl;
     std::cout << "    -ppWidth W                " << preprocessing_width << std::endl;
     std::cout << "    -ppHeight H               " << preprocessing_height << std::endl;
+    std::cout << "    -ppMean <R,G,B>           " << preprocessing_mean << std::endl;
+    std::cout << "    -ppStd <R,G,B>            " << preprocessing_std << std::endl;
+    std::cout << "    -ppScaledDecode           " << preprocessing_scaled_decode << std::endl;
     std::cout << "    --dump                    " << dump_message << std::endl;
 
     std::cout << std::endl;
@@ -220,6 +297,90 @@ std::string strtolower(const std::string& s) {
     return res;
 }
 
+static std::string trim(const std::string& s) {
+    size_t first = s.find_first_not_of(" \t\r");
+    if (first == std::string::npos) return "";
+    size_t last = s.find_last_not_of(" \t\r");
+    return s.substr(first, last - first + 1);
+}
+
+/**
+ * @brief Adds KEY=VALUE pair to the backend configuration
+ */
+static void addConfigPair(const std::string& pair, std::map<std::string, std::string>& config) {
+    size_t pos = pair.find('=');
+    std::string key = trim(pair.substr(0, pos));
+    if (pos == std::string::npos || key.empty()) {
+        THROW_USER_EXCEPTION(8) << "Invalid backend configuration entry \"" << pair << "\", KEY=VALUE is expected";
+    }
+    config[key] = trim(pair.substr(pos + 1));
+}
+
+/**
+ * @brief Collects backend configuration from -config_file and -config options
+ */
+static std::map<std::string, std::string> parseConfig(const std::string& configFile, const std::string& configLine) {
+    std::map<std::string, std::string> config;
+    if (!configFile.empty()) {
+        std::ifstream file(configFile);
+        if (!file) {
+            THROW_USER_EXCEPTION(8) << "Backend configuration file \"" << configFile << "\" not found or inaccessible";
+        }
+        std::string line;
+        while (std::getline(file, line)) {
+            line = trim(line);
+            if (line.empty() || line[0] == '#') continue;
+            addConfigPair(line, config);
+        }
+    }
+
+    std::istringstream stream(configLine);
+    std::string pair;
+    while (std::getline(stream, pair, ',')) {
+        if (trim(pair).empty()) continue;
+        addConfigPair(pair, config);
+    }
+    return config;
+}
+
+/**
+ * @brief Parses values of R, G and B channels given as "R,G,B", empty line gives no values
+ * @return false if the line is not 3 numbers
+ */
+static bool parseChannelValues(const std::string& line, std::vector<float>& values) {
+    values.clear();
+    if (trim(line).empty()) {
+        return true;
+    }
+    std::istringstream stream(line);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        item = trim(item);
+        char* end = nullptr;
+        float value = std::strtof(item.c_str(), &end);
+        if (item.empty() || *end != '\0') {
+            return false;
+        }
+        values.push_back(value);
+    }
+    return values.size() == 3;
+}
+
+/**
+ * @brief Writes per-layer profile of the backend to .csv file, the hottest layer first
+ */
+static void exportProfile(const std::string& fileName, const VProfile& profile) {
+    std::ofstream file(fileName);
+    if (!file) {
+        THROW_USER_EXCEPTION(1) << "Cannot create file \"" << fileName << "\"";
+    }
+    file << "layer;type;count;avg_ms;total_ms" << std::endl;
+    for (auto& layer : profile) {
+        file << layer._name << ";" << layer._type << ";" << layer._count << ";"
+             << (layer._count ? layer._totalTime / layer._count : 0.) << ";" << layer._totalTime << std::endl;
+    }
+}
+
 /**
  * @brief The main function of Inference Engine sample application
  * @param argc - The number of arguments
@@ -255,6 +416,10 @@ int main(int argc, char *argv[]) {
         if (!backend) {
             THROW_USER_EXCEPTION(2) << "Cannot create inference backend" << dlerror();
         }
+        // allocator is set before the model is loaded, blobs of the backend are allocated by it
+        if (FLAGS_huge_pages) {
+            backend->setAllocator(std::make_shared<AlignedAllocator>(true));
+        }
 
 
         NetworkType netType = Undefined;
@@ -272,6 +437,17 @@ int main(int argc, char *argv[]) {
         if (FLAGS_i.empty()) ee << UserException(4, "Images list is not specified (missing -i option)");
         if (FLAGS_d.empty()) ee << UserException(5, "Target device is not specified (missing -d option)");
         if (FLAGS_b < 0) ee << UserException(6, "Batch must be positive (invalid -b option value)");
+        if (FLAGS_nireq < 0) ee << UserException(7, "Number of infer requests must not be negative (invalid -nireq option value)");
+        if (FLAGS_decode_threads < 0) ee << UserException(7, "Number of decode threads must not be negative (invalid -decode_threads option value)");
+        if (FLAGS_prefetch < 1) ee << UserException(7, "Prefetch depth must be positive (invalid -prefetch option value)");
+        std::vector<float> ppMean, ppStd;
+        if (!parseChannelValues(FLAGS_ppMean, ppMean)) {
+            ee << UserException(13, "Mean must be 3 numbers of R, G and B channels (invalid -ppMean option value)");
+        }
+        if (!parseChannelValues(FLAGS_ppStd, ppStd) ||
+            std::find(ppStd.begin(), ppStd.end(), 0.f) != ppStd.end()) {
+            ee << UserException(13, "Deviation must be 3 non-zero numbers of R, G and B channels (invalid -ppStd option value)");
+        }
 
         if (netType == ObjDetection) {
             // Checking required OD-specific options
@@ -298,6 +474,29 @@ int main(int argc, char *argv[]) {
 
         CsvDumper dumper(FLAGS_dump);
 
+        std::map<std::string, std::string> config = parseConfig(FLAGS_config_file, FLAGS_config);
+        if (FLAGS_pc || !FLAGS_pc_csv.empty()) {
+            config[BackendConfig::PROFILING] = BackendConfig::YES;
+        }
+        // explicit BATCH of the configuration wins over -b
+        if (FLAGS_b > 0 && config.find(BackendConfig::BATCH) == config.end()) {
+            config[BackendConfig::BATCH] = std::to_string(FLAGS_b);
+        }
+        // backend normalizes images it preprocesses itself by the same mean and deviation as the app
+        if (!ppMean.empty() && config.find(BackendConfig::MEAN_VALUES) == config.end()) {
+            config[BackendConfig::MEAN_VALUES] = FLAGS_ppMean;
+        }
+        if (!ppStd.empty() && config.find(BackendConfig::STD_VALUES) == config.end()) {
+            config[BackendConfig::STD_VALUES] = FLAGS_ppStd;
+        }
+        // explicit REQUESTS_NUM of the configuration wins over -nireq
+        if (config.find(BackendConfig::REQUESTS_NUM) == config.end()) {
+            config[BackendConfig::REQUESTS_NUM] = std::to_string(FLAGS_nireq);
+        }
+        for (auto& item : config) {
+            slog::info << "Backend config: " << item.first << "=" << item.second << slog::endl;
+        }
+
         std::shared_ptr<Processor> processor;
 
         PreprocessingOptions preprocessingOptions;
@@ -323,7 +522,7 @@ int main(int argc, char *argv[]) {
 
         if (netType == Classification) {
             processor = std::shared_ptr<Processor>(
-                new ClassificationProcessor(backend, FLAGS_m, {}, FLAGS_d, FLAGS_i, FLAGS_b,
+                new ClassificationProcessor(backend, FLAGS_m, {}, config, FLAGS_d, FLAGS_i, FLAGS_b,
                                                 dumper, FLAGS_lbl, preprocessingOptions, FLAGS_Czb));
         } else if (netType == ObjDetection) {
             if (FLAGS_ODkind == "SSD") {
@@ -334,11 +533,11 @@ int main(int argc, char *argv[]) {
                     outputs.push_back("Postprocessor/BatchMultiClassNonMaxSuppression");
                 }
                 processor = std::shared_ptr<Processor>(
-                    new SSDObjectDetectionProcessor(backend, FLAGS_m, outputs, FLAGS_d, FLAGS_i, FLAGS_ODsubdir, FLAGS_b,
+                    new SSDObjectDetectionProcessor(backend, FLAGS_m, outputs, config, FLAGS_d, FLAGS_i, FLAGS_ODsubdir, FLAGS_b,
                                                         0.5, dumper, FLAGS_ODa, FLAGS_ODc));
             } else if (FLAGS_ODkind == "YOLO") {
                 processor = std::shared_ptr<Processor>(
-                    new YOLOObjectDetectionProcessor(backend, FLAGS_m, { }, FLAGS_d, FLAGS_i, FLAGS_ODsubdir, FLAGS_b,
+                    new YOLOObjectDetectionProcessor(backend, FLAGS_m, { }, config, FLAGS_d, FLAGS_i, FLAGS_ODsubdir, FLAGS_b,
                                                          0.5, dumper, FLAGS_ODa, FLAGS_ODc));
             }
         } else {
@@ -347,10 +546,18 @@ int main(int argc, char *argv[]) {
         if (!processor.get()) {
             THROW_USER_EXCEPTION(2) <<  "Processor pointer is invalid" << FLAGS_ppType;
         }
+        processor->SetDecoding(FLAGS_decode_threads, FLAGS_prefetch);
+        processor->SetNormalization(ppMean, ppStd);
+        processor->SetScaledDecode(FLAGS_ppScaledDecode);
         slog::info << (FLAGS_d.empty() ? "Plugin: " + FLAGS_p : "Device: " + FLAGS_d) << slog::endl;
         shared_ptr<Processor::InferenceMetrics> pIM = processor->Process(FLAGS_plain);
         processor->Report(*pIM.get());
 
+        if (!FLAGS_pc_csv.empty()) {
+            exportProfile(FLAGS_pc_csv, backend->getProfile());
+            slog::info << "Per-layer profile exported to " << FLAGS_pc_csv << slog::endl;
+        }
+
         if (dumper.dumpEnabled()) {
             slog::info << "Dump file generated: " << dumper.getFilename() << slog::endl;
         }
@@ -0,0 +1,184 @@
+// Copyright 2021 the dldt tools authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+
+#include "preprocessing_plan.hpp"
+
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "user_exception.hpp"
+
+int getLoadModeForChannels(int channels, int base) {
+    switch (channels) {
+    case 1:
+        return base | cv::IMREAD_GRAYSCALE;
+    case 3:
+        return base | cv::IMREAD_COLOR;
+    }
+    return base | cv::IMREAD_UNCHANGED;
+}
+
+// ImageNet statistics of R, G and B channels
+static const float IMAGENET_MEAN[3] = { 123.6f, 116.3f, 103.5f };
+static const float IMAGENET_DEVIATION[3] = { 58.395f, 57.12f, 57.375f };
+
+static int channelsOf(const VBlob &input) {
+    if (input._shape.size() != 4) {
+        THROW_USER_EXCEPTION(1) << "Images are set to 4D inputs only";
+    }
+    return static_cast<int>(input._layout == NCHW ? input._shape[1] : input._shape[3]);
+}
+
+static PixelTransform makeTransform(const PreprocessingOptions &options, const VBlob &input, bool colourImage) {
+    const bool planar = input._layout == NCHW;
+    const bool custom = !options.mean.empty() || !options.deviation.empty();
+    const float pixelScale = options.scaleValuesTo01 ? 1.f / 255.f : 1.f;
+    const bool rgb = colourImage && input._colourFormat == RGB;
+    if (input._precision == U8 && (custom || options.scaleValuesTo01)) {
+        THROW_USER_EXCEPTION(1) << "Input of U8 precision takes pixels as they are, mean, deviation and scaling to 0..1 "
+                                   "need an input of FP32 precision";
+    }
+
+    PixelTransform transform;
+    for (int d = 0; d < 3; d++) {
+        // decoded images are BGR, single channel images take the first values of mean and deviation
+        const int source = rgb ? 2 - d : d;
+        const int colour = colourImage ? 2 - source : d;
+        transform.order[d] = source;
+        if (input._precision == U8) {
+            transform.scale[d] = 1.f;
+        } else if (custom) {
+            const float mean = options.mean.empty() ? 0.f : options.mean.at(colour);
+            const float deviation = options.deviation.empty() ? 1.f : options.deviation.at(colour);
+            transform.scale[d] = pixelScale / deviation;
+            transform.shift[d] = -mean / deviation;
+        } else if (!planar) {
+            transform.scale[d] = 1.f / 127.f;
+            transform.shift[d] = -128.f / 127.f;
+        } else if (colourImage && input._colourFormat == RGB) {
+            transform.scale[d] = pixelScale / IMAGENET_DEVIATION[colour];
+            transform.shift[d] = -IMAGENET_MEAN[colour] / IMAGENET_DEVIATION[colour];
+        } else {
+            transform.scale[d] = pixelScale;
+        }
+    }
+    return transform;
+}
+
+PreprocessingPlan::PreprocessingPlan(const PreprocessingOptions &options, const VBlob &input)
+    : _policy(options.resizeCropPolicy),
+      _transform(makeTransform(options, input, channelsOf(input) == 3)),
+      _converter(_transform) {
+    const VShape &shape = input._shape;
+    const bool planar = input._layout == NCHW;
+    const int channels = channelsOf(input);
+    _size = cv::Size(static_cast<int>(planar ? shape[3] : shape[2]), static_cast<int>(planar ? shape[2] : shape[1]));
+    _loadMode = getLoadModeForChannels(channels, 0);
+    _strides = denseStrides(shape);
+
+    if (_policy == ResizeCropPolicy::ResizeThenCrop) {
+        _resizeSize = cv::Size(static_cast<int>(options.resizeBeforeCropX), static_cast<int>(options.resizeBeforeCropY));
+        _crop = cv::Rect(_resizeSize.width / 2 - _size.width / 2, _resizeSize.height / 2 - _size.height / 2,
+                         _size.width, _size.height);
+        if (_crop.x < 0 || _crop.y < 0) {
+            THROW_USER_EXCEPTION(1) << "Crop " << _size.width << "x" << _size.height << " does not fit the image resized to "
+                                    << _resizeSize.width << "x" << _resizeSize.height;
+        }
+    } else if (_policy != ResizeCropPolicy::Resize && _policy != ResizeCropPolicy::DoNothing) {
+        THROW_USER_EXCEPTION(1) << "Unsupported ResizeCropPolicy value";
+    }
+    if (options.scaledDecode && _policy != ResizeCropPolicy::DoNothing) {
+        _decodeSize = _policy == ResizeCropPolicy::Resize ? _size : _resizeSize;
+    }
+
+    // interleaved blobs are filled for FP32 and U8 only
+    if (!planar && input._precision != FP32 && input._precision != U8) {
+        _fill = &fillNothing;
+        return;
+    }
+    switch (input._precision) {
+    case FP32:
+        _fill = selectFill<float>(planar, channels == 3);
+        break;
+    case FP16:
+    case Q78:
+    case I16:
+    case U16:
+        _fill = selectFill<short>(planar, channels == 3);
+        break;
+    default:
+        _fill = selectFill<uint8_t>(planar, channels == 3);
+    }
+}
+
+template <class T>
+PreprocessingPlan::Fill PreprocessingPlan::selectFill(bool planar, bool colour) {
+    if (colour) {
+        return planar ? &fill<T, true> : &fill<T, false>;
+    }
+    return planar ? &fillSingleChannel<T, true> : &fillSingleChannel<T, false>;
+}
+
+template <class T, bool Planar>
+void PreprocessingPlan::fill(const PreprocessingPlan &plan, const cv::Mat &image, VBlob *blob, size_t batchPos) {
+    const VShape &strides = blob->_strides.empty() ? plan._strides : blob->_strides;
+    const size_t cStride = Planar ? strides[1] : strides[3];
+    const size_t hStride = Planar ? strides[2] : strides[1];
+    const size_t wStride = Planar ? strides[3] : strides[2];
+    T *data = static_cast<T*>(blob->_data) + batchPos * strides[0];
+    for (int h = 0; h < plan._size.height; h++) {
+        plan._converter.convert(image.ptr<uint8_t>(h), plan._size.width, data + h * hStride, wStride, cStride);
+    }
+}
+
+template <class T, bool Planar>
+void PreprocessingPlan::fillSingleChannel(const PreprocessingPlan &plan, const cv::Mat &image, VBlob *blob,
+                                          size_t batchPos) {
+    // channels are not reordered, the transform of the first channel is applied to all of them
+    const VShape &strides = blob->_strides.empty() ? plan._strides : blob->_strides;
+    const size_t channels = std::min<size_t>(Planar ? blob->_shape[1] : blob->_shape[3], image.channels());
+    const size_t cStride = Planar ? strides[1] : strides[3];
+    const size_t hStride = Planar ? strides[2] : strides[1];
+    const size_t wStride = Planar ? strides[3] : strides[2];
+    const float scale = plan._transform.scale[0];
+    const float shift = plan._transform.shift[0];
+    T *data = static_cast<T*>(blob->_data) + batchPos * strides[0];
+    for (int h = 0; h < plan._size.height; h++) {
+        const uint8_t *row = image.ptr<uint8_t>(h);
+        for (int w = 0; w < plan._size.width; w++) {
+            for (size_t c = 0; c < channels; c++) {
+                data[c * cStride + h * hStride + w * wStride] =
+                    static_cast<T>(row[w * image.channels() + c] * scale + shift);
+            }
+        }
+    }
+}
+
+void PreprocessingPlan::apply(const cv::Mat &image, VBlob *blob, size_t batchPos) const {
+    cv::Mat result;
+    if (_policy == ResizeCropPolicy::Resize) {
+        cv::resize(image, result, _size);
+    } else if (_policy == ResizeCropPolicy::ResizeThenCrop) {
+        if (image.size() == _resizeSize) {
+            result = image(_crop);
+        } else {
+            // only the crop of the resized image is interpolated, from the source pixels around it
+            result.create(_size, image.type());
+            if (image.type() != CV_8UC3 ||
+                !resizeCropLinear(image.ptr<uint8_t>(), image.step, image.cols, image.rows, _resizeSize.width,
+                                  _resizeSize.height, _crop.x, _crop.y, _size.width, _size.height,
+                                  result.ptr<uint8_t>(), result.step)) {
+                cv::Mat resized;
+                cv::resize(image, resized, _resizeSize);
+                result = resized(_crop);
+            }
+        }
+    } else {
+        result = image;
+    }
+    if (result.size() != _size) {
+        THROW_USER_EXCEPTION(1) << "Image of " << result.cols << "x" << result.rows << " does not match the input of "
+                                << _size.width << "x" << _size.height << ", it must be resized";
+    }
+    _fill(*this, result, blob, batchPos);
+}
@@ -0,0 +1,79 @@
+// Copyright 2021 the dldt tools authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+
+#pragma once
+
+#include <opencv2/core/core.hpp>
+
+#include "PreprocessingOptions.hpp"
+#include "backend.hpp"
+#include "fill_kernels.hpp"
+
+/**
+ * @return OpenCV imread flags giving images of the channel count
+ */
+int getLoadModeForChannels(int channels, int base);
+
+/**
+ * Preprocessing of images for one input, built once from the options and the format of the input blob.
+ * Resize and crop sizes, normalization of channels and the kernel for the precision and layout are chosen on
+ * construction, so every image is only resized and converted by the chosen kernel.
+ * Without mean and deviation in the options the normalization is the one the app always applied:
+ *   NCHW RGB  - ImageNet mean and deviation
+ *   NCHW BGR  - none
+ *   NHWC FP32 - (pixel - 128) / 127 whatever scaleValuesTo01 is
+ *   NHWC U8   - none
+ * Channels are given in the colour format of the blob. U8 blobs take pixels as they are, the plan throws if mean,
+ * deviation or scaling to 0..1 is asked for them. Images of other channel counts than 3 are not reordered and take
+ * the first values of mean and deviation
+ */
+class PreprocessingPlan {
+public:
+    /**
+     * @param input - blob of the input, blobs the plan is applied to must have the same format, batch aside
+     */
+    PreprocessingPlan(const PreprocessingOptions &options, const VBlob &input);
+
+    /**
+     * @return OpenCV imread flags giving images of the input channel count
+     */
+    int loadMode() const {
+        return _loadMode;
+    }
+
+    /**
+     * @return size images may be reduced to when they are decoded, the resize of the plan is done from it.
+     *         Empty if images are taken in the full size
+     */
+    cv::Size decodeSize() const {
+        return _decodeSize;
+    }
+
+    /**
+     * Resizes and crops the image and writes it to the blob at the batch position
+     */
+    void apply(const cv::Mat &image, VBlob *blob, size_t batchPos) const;
+
+private:
+    typedef void (*Fill)(const PreprocessingPlan &plan, const cv::Mat &image, VBlob *blob, size_t batchPos);
+
+    template <class T, bool Planar>
+    static void fill(const PreprocessingPlan &plan, const cv::Mat &image, VBlob *blob, size_t batchPos);
+    template <class T, bool Planar>
+    static void fillSingleChannel(const PreprocessingPlan &plan, const cv::Mat &image, VBlob *blob, size_t batchPos);
+    static void fillNothing(const PreprocessingPlan &, const cv::Mat &, VBlob *, size_t) { }
+    template <class T>
+    static Fill selectFill(bool planar, bool colour);
+
+    ResizeCropPolicy _policy;
+    cv::Size _size;
+    cv::Size _resizeSize;
+    cv::Rect _crop;
+    cv::Size _decodeSize;
+    int _loadMode;
+    // strides of dense blobs, blobs having own strides are filled by them
+    VShape _strides;
+    PixelTransform _transform;
+    PixelConverter _converter;
+    Fill _fill;
+};